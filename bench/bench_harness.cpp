@@ -0,0 +1,106 @@
+#include "bench_harness.h"
+
+#include "json_string.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+namespace uvk::bench {
+
+bool BenchHarness::selected(const std::string& name) const {
+  return options_.filter.empty() || name.find(options_.filter) != std::string::npos;
+}
+
+bool BenchHarness::run(const std::string& name, const std::function<void()>& body) {
+  if (!selected(name)) {
+    return false;
+  }
+  using Clock = std::chrono::steady_clock;
+  for (size_t i = 0; i < options_.warmupIterations; ++i) {
+    body();
+  }
+  std::vector<double> samples;
+  samples.reserve(options_.repetitions);
+  double totalNs = 0.0;
+  const double budgetNs = options_.maxSecondsPerCase * 1e9;
+  for (size_t i = 0; i < options_.repetitions && (i == 0 || totalNs < budgetNs); ++i) {
+    const auto start = Clock::now();
+    body();
+    const double elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    samples.push_back(elapsed);
+    totalNs += elapsed;
+  }
+  std::sort(samples.begin(), samples.end());
+
+  BenchResult result;
+  result.name = name;
+  result.repetitions = samples.size();
+  result.minNs = samples.front();
+  result.meanNs = totalNs / static_cast<double>(samples.size());
+  result.medianNs = nearestRankPercentile(samples, 0.5);
+  result.p99Ns = nearestRankPercentile(samples, 0.99);
+  result.maxNs = samples.back();
+  results_.push_back(result);
+  return true;
+}
+
+void BenchHarness::setContext(const std::string& key, const std::string& value) {
+  for (auto& entry : context_) {
+    if (entry.first == key) {
+      entry.second = value;
+      return;
+    }
+  }
+  context_.emplace_back(key, value);
+}
+
+void BenchHarness::printSummary(std::ostream& output) const {
+  size_t width = 4;
+  for (const auto& result : results_) {
+    width = std::max(width, result.name.size());
+  }
+  const auto flags = output.flags();
+  const auto precision = output.precision();
+  output << std::left << std::setw(static_cast<int>(width)) << "Case" << std::right
+         << std::setw(8) << "reps" << std::setw(14) << "median us" << std::setw(14) << "p99 us"
+         << std::setw(14) << "max us" << '\n';
+  output << std::fixed << std::setprecision(2);
+  for (const auto& result : results_) {
+    output << std::left << std::setw(static_cast<int>(width)) << result.name << std::right
+           << std::setw(8) << result.repetitions << std::setw(14) << result.medianNs / 1000.0
+           << std::setw(14) << result.p99Ns / 1000.0 << std::setw(14)
+           << result.maxNs / 1000.0 << '\n';
+  }
+  output.flags(flags);
+  output.precision(precision);
+}
+
+void BenchHarness::writeJson(std::ostream& output) const {
+  output << "{\n  \"context\": {";
+  for (size_t i = 0; i < context_.size(); ++i) {
+    output << (i == 0 ? "\n    " : ",\n    ");
+    writeJsonString(output, context_[i].first);
+    output << ": ";
+    writeJsonString(output, context_[i].second);
+  }
+  output << (context_.empty() ? "},\n" : "\n  },\n");
+  output << "  \"benchmarks\": [";
+  const auto flags = output.flags();
+  const auto precision = output.precision();
+  output << std::fixed << std::setprecision(1);
+  for (size_t i = 0; i < results_.size(); ++i) {
+    const BenchResult& result = results_[i];
+    output << (i == 0 ? "\n    {" : ",\n    {") << "\"name\": ";
+    writeJsonString(output, result.name);
+    output << ", \"repetitions\": " << result.repetitions << ", \"min_ns\": " << result.minNs
+           << ", \"mean_ns\": " << result.meanNs << ", \"median_ns\": " << result.medianNs
+           << ", \"p99_ns\": " << result.p99Ns << ", \"max_ns\": " << result.maxNs << '}';
+  }
+  output.flags(flags);
+  output.precision(precision);
+  output << (results_.empty() ? "]\n}\n" : "\n  ]\n}\n");
+}
+
+}  // namespace uvk::bench
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace uvk::bench {
+
+struct BenchOptions {
+  // Untimed calls before measuring, to settle caches, allocations and lazy initialization.
+  size_t warmupIterations{10};
+  size_t repetitions{200};
+  // A case stops early once its timed calls exceed this, so slow cases stay bounded.
+  double maxSecondsPerCase{10.0};
+  // Only cases whose name contains this substring run; empty runs everything.
+  std::string filter;
+};
+
+// Per-call wall-clock times of one case, in nanoseconds.
+struct BenchResult {
+  std::string name;
+  size_t repetitions{};
+  double minNs{};
+  double meanNs{};
+  double medianNs{};
+  double p99Ns{};
+  double maxNs{};
+};
+
+// Times each case call by call, so the median and tail percentiles come from the same
+// samples. Results are printed as a table and can be written as JSON for regression
+// tracking.
+class BenchHarness {
+ public:
+  explicit BenchHarness(BenchOptions options) : options_(std::move(options)) {}
+
+  // Returns false when the case was filtered out.
+  bool run(const std::string& name, const std::function<void()>& body);
+  // Recorded in the JSON "context" object, e.g. the Vulkan device the GPU cases ran on.
+  void setContext(const std::string& key, const std::string& value);
+
+  [[nodiscard]] bool selected(const std::string& name) const;
+  [[nodiscard]] const std::vector<BenchResult>& results() const noexcept { return results_; }
+  void printSummary(std::ostream& output) const;
+  void writeJson(std::ostream& output) const;
+
+ private:
+  BenchOptions options_;
+  std::vector<BenchResult> results_;
+  std::vector<std::pair<std::string, std::string>> context_;
+};
+
+// Keeps the compiler from discarding a result that is otherwise unused.
+template <typename T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  const volatile auto* sink = &value;
+  (void)sink;
+#endif
+}
+
+}  // namespace uvk::bench
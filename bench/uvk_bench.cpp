@@ -0,0 +1,403 @@
+#include "bench_harness.h"
+
+#include "audio_stream.h"
+#include "differential_math.h"
+#include "enki_ts.h"
+#include "spectrum_analyzer.h"
+#include "surround_analyzer.h"
+#include "visualizer.h"
+#include "visualizer_presets.h"
+#include "vulkan_app.h"
+#include "waterfall_format.h"
+#include "waterfall_renderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace uvk::bench {
+
+namespace {
+
+constexpr float kSampleRate = 48000.0f;
+constexpr int kBlockSize = 1024;
+
+struct BenchCommandLine {
+  BenchOptions options;
+  std::string jsonPath;
+  bool gpu{true};
+};
+
+void runCpuCases(BenchHarness& harness) {
+  AudioStream stream(kSampleRate, kBlockSize);
+  harness.run("audio/next_block/" + std::to_string(kBlockSize), [&]() {
+    const SurroundBlock block = stream.nextBlock();
+    doNotOptimize(block.samples.data());
+  });
+  const SurroundBlock block = stream.nextBlock();
+
+  SurroundAnalyzer surround;
+  harness.run("surround/analyze/" + std::to_string(kBlockSize), [&]() {
+    const SurroundAnalysis analysis = surround.analyze(block);
+    doNotOptimize(analysis.energy);
+  });
+
+  SpectrumAnalyzer spectrum;
+  EnkiTaskScheduler scheduler;
+  scheduler.initialize();
+  for (const auto& preset : availablePresets()) {
+    const std::string name = "spectrum/" + preset.name + "/" + std::to_string(preset.fftSize);
+    harness.run(name, [&]() {
+      const SpectrumFrame frame =
+          spectrum.analyze(block, preset.fftSize, preset.bandEdgesHz, nullptr);
+      doNotOptimize(frame.magnitudes.data());
+    });
+    harness.run(name + "/threaded", [&]() {
+      const SpectrumFrame frame =
+          spectrum.analyze(block, preset.fftSize, preset.bandEdgesHz, &scheduler);
+      doNotOptimize(frame.magnitudes.data());
+    });
+  }
+  // Band edges no built-in preset uses take the generic path, so the difference to the cases
+  // above is what the specialized kernels save.
+  const std::vector<float> customBands{20.0f, 20000.0f};
+  for (int fftSize : {256, 512}) {
+    harness.run("spectrum/generic/" + std::to_string(fftSize), [&]() {
+      const SpectrumFrame frame = spectrum.analyze(block, fftSize, customBands, nullptr);
+      doNotOptimize(frame.magnitudes.data());
+    });
+  }
+
+  // One column per pixel of a 1280-wide window and the default history length.
+  constexpr size_t kColumns = 1280;
+  constexpr size_t kRows = 120;
+  std::vector<float> waterfall(kColumns * kRows);
+  std::mt19937 random(7);
+  std::uniform_real_distribution<float> magnitude(0.0f, 1.0f);
+  for (float& sample : waterfall) {
+    sample = magnitude(random);
+  }
+  harness.run("differential/analyze_waterfall/" + std::to_string(kColumns) + "x" +
+                  std::to_string(kRows),
+              [&]() {
+                const DifferentialBounds bounds =
+                    DifferentialMath::analyzeWaterfall(waterfall, kColumns, kRows, true);
+                doNotOptimize(bounds);
+              });
+  // The full scan with row and band statistics, from floats and from 8-bit dB rows decoded
+  // on the fly, as the renderer's history is scanned.
+  constexpr size_t kBands = 8;
+  const std::string size = std::to_string(kColumns) + "x" + std::to_string(kRows);
+  harness.run("differential/scan_waterfall/" + size + "/threaded", [&]() {
+    const WaterfallStatistics statistics =
+        DifferentialMath::scanWaterfall(waterfall, kColumns, kRows, 0, kBands, &scheduler);
+    doNotOptimize(statistics.bandMeans.data());
+  });
+  WaterfallEncoding encoding;
+  encoding.format = WaterfallFormat::Db8;
+  const WaterfallCodec codec(encoding);
+  std::vector<unsigned char> encoded(kColumns * kRows * codec.bytesPerSample());
+  codec.encode(waterfall.data(), waterfall.size(), encoded.data());
+  const DifferentialMath::RowReader readRow = [&](size_t row, float* output) {
+    codec.decode(encoded.data() + row * kColumns * codec.bytesPerSample(), kColumns, output);
+  };
+  harness.run("differential/scan_rows/db8/" + size, [&]() {
+    const WaterfallStatistics statistics =
+        DifferentialMath::scanRows(readRow, kColumns, kRows, 0, kBands, nullptr);
+    doNotOptimize(statistics.bandMeans.data());
+  });
+  harness.run("differential/scan_rows/db8/" + size + "/threaded", [&]() {
+    const WaterfallStatistics statistics =
+        DifferentialMath::scanRows(readRow, kColumns, kRows, 0, kBands, &scheduler);
+    doNotOptimize(statistics.bandMeans.data());
+  });
+}
+
+// Copies a device-local buffer into host memory on the graphics queue; the device must be idle.
+std::vector<float> readBuffer(VulkanContext& context, const VulkanBuffer& source) {
+  VulkanBuffer host = context.createBuffer(source.size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  poolInfo.queueFamilyIndex = context.graphicsFamilyIndex();
+  VkCommandPool pool = VK_NULL_HANDLE;
+  if (vkCreateCommandPool(context.device(), &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+    context.destroyBuffer(host);
+    throw std::runtime_error("Failed to create readback command pool.");
+  }
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = pool;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+  VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+  vkAllocateCommandBuffers(context.device(), &allocInfo, &commandBuffer);
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vkBeginCommandBuffer(commandBuffer, &beginInfo);
+  VkBufferCopy region{};
+  region.size = source.size;
+  vkCmdCopyBuffer(commandBuffer, source.buffer, host.buffer, 1, &region);
+  VkMemoryBarrier toHost{};
+  toHost.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                       0, 1, &toHost, 0, nullptr, 0, nullptr);
+  vkEndCommandBuffer(commandBuffer);
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+  const bool submitted =
+      vkQueueSubmit(context.graphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE) == VK_SUCCESS &&
+      vkQueueWaitIdle(context.graphicsQueue()) == VK_SUCCESS;
+  vkDestroyCommandPool(context.device(), pool, nullptr);
+  std::vector<float> values;
+  if (submitted) {
+    context.invalidateBuffer(host);
+    values.resize(source.size / sizeof(float));
+    std::memcpy(values.data(), host.mapped, values.size() * sizeof(float));
+  }
+  context.destroyBuffer(host);
+  if (!submitted) {
+    throw std::runtime_error("Failed to submit readback command buffer.");
+  }
+  return values;
+}
+
+// Runs the GPU post-processing path offscreen and checks both compute passes: the history the
+// GPU wrote against a CPU model of the dB mapping, smoothing and peak hold, and the reduced
+// bounds against an analyzeRows() scan of that same history. Skipped (and passing) when the
+// graphics queue has no compute. Returns false after reporting a mismatch.
+bool checkPostProcess() {
+  constexpr size_t kBins = 256;
+  constexpr size_t kRows = 24;
+  // Enough rows to wrap the ring twice.
+  constexpr size_t kUpdates = 2 * kRows + 5;
+  VulkanApp app;
+  app.initializeOffscreen("uvk_bench post-process check", OffscreenOptions{});
+  if (!WaterfallPostProcessor::supported(app.context())) {
+    std::cout << "Skipping the post-processing check: no compute on the graphics queue.\n";
+    app.shutdown();
+    return true;
+  }
+
+  WaterfallPostProcessOptions options;
+  options.enabled = true;
+  options.decibels = true;
+  options.smoothing = 0.5f;
+  options.peakDecay = 0.9f;
+  WaterfallHistoryOptions history;
+  history.rowsPerTier = kRows;
+  WaterfallRenderer waterfall;
+  waterfall.setPostProcess(options, &app.pipelineCache());
+  waterfall.initialize(app.context(), kBins, history);
+  app.setWaterfallSource(waterfall.buffer(), waterfall.layout());
+  app.setTransferRecorder(
+      [&waterfall](const UploadCommands& commands) { return waterfall.recordUpload(commands); });
+
+  // What waterfall_post.comp.glsl computes, one row per frame.
+  const WaterfallEncoding& encoding = waterfall.encoding();
+  std::vector<float> expected(kBins * kRows, 0.0f);
+  std::vector<float> smoothed(kBins, 0.0f);
+  std::vector<float> held(kBins, 0.0f);
+  std::mt19937 random(13);
+  std::uniform_real_distribution<float> magnitude(0.0f, 1.0f);
+  SpectrumFrame frame;
+  frame.magnitudes.resize(kBins);
+  for (size_t update = 0; update < kUpdates; ++update) {
+    for (float& sample : frame.magnitudes) {
+      // Mostly quiet with occasional peaks, so the hold has something to decay from.
+      sample = magnitude(random) < 0.1f ? magnitude(random) : 0.001f * magnitude(random);
+    }
+    waterfall.update(frame);
+    const size_t head = waterfall.tierHeads()[0];
+    for (size_t col = 0; col < kBins; ++col) {
+      const float db = 20.0f * std::log10(std::max(frame.magnitudes[col], 1e-30f));
+      const float value =
+          std::clamp((db - encoding.minDb) / (encoding.maxDb - encoding.minDb), 0.0f, 1.0f);
+      smoothed[col] = value + (smoothed[col] - value) * options.smoothing;
+      held[col] = std::max(smoothed[col], held[col] * options.peakDecay);
+      expected[head * kBins + col] = held[col];
+    }
+    app.setWaterfallHeads(waterfall.tierHeads());
+    app.renderFrame();
+  }
+  // bounds() lags by one submission per frame in flight; frames without a new row only rerun
+  // the reduction over the same history.
+  for (size_t frameIndex = 0; frameIndex < kMaxFramesInFlight; ++frameIndex) {
+    app.renderFrame();
+  }
+  vkDeviceWaitIdle(app.context().device());
+  const DifferentialBounds reduced = waterfall.differentialBounds();
+  const std::vector<float> written = readBuffer(app.context(), waterfall.buffer());
+  const size_t head = waterfall.tierHeads()[0];
+  waterfall.shutdown();
+  app.shutdown();
+
+  bool passed = true;
+  size_t mismatches = 0;
+  for (size_t i = 0; i < expected.size(); ++i) {
+    if (i >= written.size() || std::abs(written[i] - expected[i]) > 1e-4f) {
+      ++mismatches;
+    }
+  }
+  if (mismatches > 0) {
+    std::cerr << "Check failed: " << mismatches << " of " << expected.size()
+              << " post-processed samples differ from the CPU dB/smoothing/peak-hold model\n";
+    passed = false;
+  }
+
+  const DifferentialBounds rescanned = DifferentialMath::analyzeRows(
+      [&written](size_t row, float* output) {
+        std::copy_n(written.begin() + static_cast<std::ptrdiff_t>(row * kBins), kBins, output);
+      },
+      kBins, kRows, true, head);
+  // The GPU sums floats per lane and per workgroup, so only the gradients may differ, and only
+  // by rounding.
+  const auto close = [](float a, float b) {
+    return std::abs(a - b) <= 1e-5f + 1e-3f * std::abs(b);
+  };
+  bool matches = written.size() >= expected.size();
+  for (size_t axis = 0; axis < 3; ++axis) {
+    matches = matches && reduced.bounds.min[axis] == rescanned.bounds.min[axis] &&
+              reduced.bounds.max[axis] == rescanned.bounds.max[axis] &&
+              close(reduced.gradient[axis], rescanned.gradient[axis]);
+  }
+  if (!matches) {
+    std::cerr << "Check failed: the GPU reduction differs from analyzeRows() over the history "
+                 "it reduced\n";
+    passed = false;
+  }
+  return passed;
+}
+
+// Cases that need a device: the waterfall allocates GPU buffers, and the end-to-end frame
+// renders offscreen, so they run on lavapipe as well. Returns false when a correctness check
+// run alongside them failed.
+bool runGpuCases(BenchHarness& harness) {
+  if (!harness.selected("waterfall/") && !harness.selected("frame/")) {
+    return true;
+  }
+  // Uses a device of its own, since the post-processed waterfall is drawn as the app's source.
+  const bool postProcessPassed = checkPostProcess();
+  VulkanApp app;
+  app.initializeOffscreen("uvk_bench", OffscreenOptions{});
+  harness.setContext("vulkan_device", app.context().properties().deviceName);
+
+  const SpectrumPreset preset = makeWidebandPreset();
+  const size_t binCount = static_cast<size_t>(preset.fftSize) / 2;
+  BinAggregationOptions aggregation;
+  aggregation.columns = app.extent().width;
+  AudioStream stream(kSampleRate, kBlockSize);
+  SurroundAnalyzer surround;
+  SpectrumAnalyzer spectrum;
+  EnkiTaskScheduler scheduler;
+  scheduler.initialize();
+
+  {
+    WaterfallRenderer waterfall;
+    waterfall.initialize(app.context(), binCount, WaterfallHistoryOptions{}, aggregation);
+    const SpectrumFrame frame =
+        spectrum.analyze(stream.nextBlock(), preset.fftSize, preset.bandEdgesHz, nullptr);
+    harness.run("waterfall/update/" + std::to_string(waterfall.binCount()),
+                [&]() { waterfall.update(frame); });
+    waterfall.shutdown();
+  }
+
+  Visualizer visualizer;
+  visualizer.initialize(app.context(), binCount, WaterfallHistoryOptions{}, aggregation);
+  app.setWaterfallSource(visualizer.waterfallBuffer(), visualizer.waterfallLayout());
+  app.setTransferRecorder(
+      [&visualizer](const UploadCommands& commands) { return visualizer.recordUploads(commands); });
+  // Everything VisualizerApp does per frame, minus capture pacing. With frames in flight a
+  // frame's time includes waiting for the one submitted framesInFlight() frames earlier.
+  harness.run("frame/headless/" + preset.name, [&]() {
+    const SurroundBlock block = stream.nextBlock();
+    const SurroundAnalysis analysis = surround.analyze(block);
+    const SpectrumFrame frame =
+        spectrum.analyze(block, preset.fftSize, preset.bandEdgesHz, &scheduler);
+    visualizer.update(analysis, frame);
+    app.setWaterfallHeads(visualizer.waterfallHeads());
+    app.setWaterfallCopy(visualizer.waterfallCopy());
+    app.setAnalysisMetrics(visualizer.analysisMetrics());
+    app.renderFrame();
+  });
+  vkDeviceWaitIdle(app.context().device());
+  visualizer.shutdown();
+  app.shutdown();
+  return postProcessPassed;
+}
+
+}  // namespace
+
+}  // namespace uvk::bench
+
+int main(int argc, char** argv) {
+  try {
+    uvk::bench::BenchCommandLine commandLine;
+    uvk::bench::BenchOptions& options = commandLine.options;
+    for (int i = 1; i < argc; ++i) {
+      const std::string arg = argv[i];
+      if (arg.rfind("--repetitions=", 0) == 0) {
+        options.repetitions = std::max<size_t>(std::stoul(arg.substr(14)), 1);
+      } else if (arg.rfind("--warmup=", 0) == 0) {
+        options.warmupIterations = std::stoul(arg.substr(9));
+      } else if (arg.rfind("--max-seconds=", 0) == 0) {
+        options.maxSecondsPerCase = std::stod(arg.substr(14));
+      } else if (arg.rfind("--filter=", 0) == 0) {
+        options.filter = arg.substr(9);
+      } else if (arg.rfind("--json=", 0) == 0) {
+        commandLine.jsonPath = arg.substr(7);
+      } else if (arg == "--no-gpu") {
+        commandLine.gpu = false;
+      } else if (arg == "--help") {
+        std::cout << "Usage: uvk_bench [--repetitions=N] [--warmup=N] [--max-seconds=S]\n"
+                     "       [--filter=substring] [--json=results.json] [--no-gpu]\n";
+        return 0;
+      } else {
+        std::cerr << "Unknown option '" << arg << "', ignoring.\n";
+      }
+    }
+
+    uvk::bench::BenchHarness harness(options);
+    harness.setContext("hardware_threads", std::to_string(std::thread::hardware_concurrency()));
+    uvk::bench::runCpuCases(harness);
+    bool checksPassed = true;
+    if (commandLine.gpu) {
+      try {
+        checksPassed = uvk::bench::runGpuCases(harness);
+      } catch (const std::exception& ex) {
+        std::cerr << "Skipping GPU cases: " << ex.what() << '\n';
+      }
+    }
+
+    harness.printSummary(std::cout);
+    if (!commandLine.jsonPath.empty()) {
+      std::ofstream file(commandLine.jsonPath);
+      if (!file) {
+        throw std::runtime_error("Failed to open benchmark output file: " +
+                                 commandLine.jsonPath);
+      }
+      harness.writeJson(file);
+    }
+    if (!checksPassed) {
+      return 1;
+    }
+  } catch (const std::exception& ex) {
+    std::cerr << "Benchmark failed: " << ex.what() << '\n';
+    return 1;
+  }
+  return 0;
+}
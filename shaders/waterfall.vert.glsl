@@ -1,37 +1,65 @@
 #version 450
 
+// Raw 32-bit words; frame.encoding.x says how samples are packed into them.
 layout(set = 0, binding = 0) readonly buffer WaterfallBuffer {
-    float samples[];
+    uint words[];
 } waterfall;
 
-layout(set = 0, binding = 1) readonly buffer AnalysisBuffer {
+// Per-frame copy owned by the frame in flight that reads it.
+layout(set = 0, binding = 1) uniform FrameData {
+    mat4 projection;
     vec4 metrics;
-} analysis;
+    // x = bin count, y = total rows, z = rows per tier, w = tier count.
+    vec4 layout;
+    // x = format (0 float32, 1 float16, 2 8-bit dB), y = min dB, z = max dB, w = first word of
+    // the history copy being drawn.
+    vec4 encoding;
+    // Head row of each tier's ring, tiers 0-3 then 4-7.
+    vec4 tierHeads[2];
+} frame;
 
-layout(push_constant) uniform PushConstants {
-    mat4 projection;
-    float binCount;
-    float historyLength;
-} pushConstants;
+// Decodes to linear magnitude whatever the storage format, matching WaterfallCodec::decode.
+float loadSample(int index) {
+    int format = int(frame.encoding.x);
+    int base = int(frame.encoding.w);
+    if (format == 1) {
+        return unpackHalf2x16(waterfall.words[base + (index >> 1)])[index & 1];
+    }
+    if (format == 2) {
+        uint code = (waterfall.words[base + (index >> 2)] >> (8 * (index & 3))) & 0xFFu;
+        if (code == 0u) {
+            return 0.0;
+        }
+        float db = mix(frame.encoding.y, frame.encoding.z, float(code) / 255.0);
+        return pow(10.0, db / 20.0);
+    }
+    return uintBitsToFloat(waterfall.words[base + index]);
+}
 
 layout(location = 0) out vec3 fragColor;
 
 void main() {
     int index = gl_VertexIndex;
-    int bins = int(pushConstants.binCount);
-    int rows = int(pushConstants.historyLength);
-    if (bins <= 0 || rows <= 0) {
+    int bins = int(frame.layout.x);
+    int rows = int(frame.layout.y);
+    int rowsPerTier = int(frame.layout.z);
+    if (bins <= 0 || rows <= 0 || rowsPerTier <= 0) {
         gl_Position = vec4(0.0);
         fragColor = vec3(0.0);
         return;
     }
     int col = index % bins;
     int row = index / bins;
+    // Each tier is a ring whose logical row 0 (its newest) starts at the tier's head row.
+    // Later tiers hold coarser rows, so depth runs further back in time per row.
+    int tier = row / rowsPerTier;
+    int head = int(frame.tierHeads[tier >> 2][tier & 3]);
+    int physicalRow = tier * rowsPerTier + (row % rowsPerTier + head) % rowsPerTier;
     float x = (float(col) / float(max(bins - 1, 1))) * 2.0 - 1.0;
     float z = (float(row) / float(max(rows - 1, 1))); // Vulkan NDC depth range is [0.0, 1.0]
-    float height = waterfall.samples[index];
-    float energy = analysis.metrics.x;
-    gl_Position = pushConstants.projection * vec4(x, height, z, 1.0);
+    float height = loadSample(physicalRow * bins + col);
+    float energy = frame.metrics.x;
+    gl_Position = frame.projection * vec4(x, height, z, 1.0);
     gl_PointSize = 2.0;
     fragColor = vec3(height + energy * 0.05, 0.4 + height * 0.6, 1.0 - height);
 }
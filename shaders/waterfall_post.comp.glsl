@@ -0,0 +1,122 @@
+#version 450
+
+// Pass 0 post-processes the newest raw row into the waterfall history; pass 1 reduces the
+// whole history to bounds and gradient sums, one partial result per workgroup.
+layout(constant_id = 0) const int kPass = 0;
+
+layout(local_size_x = 64) in;
+
+layout(set = 0, binding = 0) buffer WaterfallBuffer {
+    float samples[];
+} waterfall;
+
+// Aggregated linear magnitudes, uploaded once per frame.
+layout(set = 0, binding = 1) readonly buffer RawRow {
+    float values[];
+} raw;
+
+// Smoothed values for each column, followed by the held peaks.
+layout(set = 0, binding = 2) buffer PostState {
+    float values[];
+} state;
+
+// Per workgroup: min, max, dx, dy, dz and three unused floats.
+layout(set = 0, binding = 3) writeonly buffer Results {
+    float values[];
+} results;
+
+// Mirrors WaterfallPostProcessor::Params.
+layout(push_constant) uniform Params {
+    uint bins;
+    uint rows;
+    uint headRow;
+    uint rowsPerGroup;
+    uint resultOffset;
+    uint decibels;
+    float minDb;
+    float maxDb;
+    float smoothing;
+    float peakDecay;
+} params;
+
+shared float sharedMin[64];
+shared float sharedMax[64];
+shared float sharedDx[64];
+shared float sharedDy[64];
+shared float sharedDz[64];
+
+void processRow() {
+    uint col = gl_GlobalInvocationID.x;
+    if (col >= params.bins) {
+        return;
+    }
+    float value = raw.values[col];
+    if (params.decibels != 0u) {
+        // Same dB mapping as the 8-bit storage format, scaled to [0, 1].
+        float db = 20.0 * log2(max(value, 1e-30)) * 0.30103;
+        value = clamp((db - params.minDb) / (params.maxDb - params.minDb), 0.0, 1.0);
+    }
+    float smoothed = mix(value, state.values[col], params.smoothing);
+    state.values[col] = smoothed;
+    float held = max(smoothed, state.values[params.bins + col] * params.peakDecay);
+    state.values[params.bins + col] = held;
+    waterfall.samples[params.headRow * params.bins + col] = held;
+}
+
+// Matches DifferentialMath::analyzeRows over the logical (newest first) row order.
+void reduceHistory() {
+    uint lane = gl_LocalInvocationID.x;
+    uint firstRow = gl_WorkGroupID.x * params.rowsPerGroup;
+    uint lastRow = min(firstRow + params.rowsPerGroup, params.rows);
+    float minimum = 3.402823e38;
+    float maximum = -3.402823e38;
+    float dx = 0.0;
+    float dy = 0.0;
+    float dz = 0.0;
+    for (uint row = firstRow; row < lastRow; ++row) {
+        uint physical = ((params.headRow + row) % params.rows) * params.bins;
+        uint previous = ((params.headRow + row + params.rows - 1u) % params.rows) * params.bins;
+        for (uint col = lane; col < params.bins; col += 64u) {
+            float current = waterfall.samples[physical + col];
+            minimum = min(minimum, current);
+            maximum = max(maximum, current);
+            if (row > 0u && col > 0u) {
+                dx += current - waterfall.samples[physical + col - 1u];
+                dy += abs(current);
+                dz += current - waterfall.samples[previous + col];
+            }
+        }
+    }
+    sharedMin[lane] = minimum;
+    sharedMax[lane] = maximum;
+    sharedDx[lane] = dx;
+    sharedDy[lane] = dy;
+    sharedDz[lane] = dz;
+    barrier();
+    for (uint stride = 32u; stride > 0u; stride >>= 1) {
+        if (lane < stride) {
+            sharedMin[lane] = min(sharedMin[lane], sharedMin[lane + stride]);
+            sharedMax[lane] = max(sharedMax[lane], sharedMax[lane + stride]);
+            sharedDx[lane] += sharedDx[lane + stride];
+            sharedDy[lane] += sharedDy[lane + stride];
+            sharedDz[lane] += sharedDz[lane + stride];
+        }
+        barrier();
+    }
+    if (lane == 0u) {
+        uint base = params.resultOffset + gl_WorkGroupID.x * 8u;
+        results.values[base + 0u] = sharedMin[0];
+        results.values[base + 1u] = sharedMax[0];
+        results.values[base + 2u] = sharedDx[0];
+        results.values[base + 3u] = sharedDy[0];
+        results.values[base + 4u] = sharedDz[0];
+    }
+}
+
+void main() {
+    if (kPass == 0) {
+        processRow();
+    } else {
+        reduceHistory();
+    }
+}
@@ -0,0 +1,53 @@
+#include "bin_aggregator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace uvk {
+
+void BinAggregator::configure(size_t inputBins, const BinAggregationOptions& options) {
+  inputBins_ = inputBins;
+  logFrequency_ = options.logFrequency && inputBins > 2;
+  columnCount_ = options.columns == 0 ? inputBins : std::min(options.columns, inputBins);
+  passthrough_ = !logFrequency_ && columnCount_ == inputBins_;
+  columnBegin_.assign(columnCount_, 0);
+  columnEnd_.assign(columnCount_, 0);
+  if (passthrough_ || columnCount_ == 0) {
+    return;
+  }
+
+  const double columns = static_cast<double>(columnCount_);
+  const double bins = static_cast<double>(inputBins_);
+  const auto edge = [&](size_t column) {
+    const double fraction = static_cast<double>(column) / columns;
+    // Log edges run from bin 1 to inputBins, linear edges from bin 0.
+    return logFrequency_ ? std::pow(bins, fraction) : fraction * bins;
+  };
+  for (size_t c = 0; c < columnCount_; ++c) {
+    const size_t begin = std::min(static_cast<size_t>(edge(c)), inputBins_ - 1);
+    const size_t end = std::clamp(static_cast<size_t>(edge(c + 1)), begin + 1, inputBins_);
+    columnBegin_[c] = static_cast<uint32_t>(begin);
+    columnEnd_[c] = static_cast<uint32_t>(end);
+  }
+}
+
+void BinAggregator::aggregate(const float* input, size_t inputCount, float* output) const {
+  const size_t available = std::min(inputCount, inputBins_);
+  if (passthrough_) {
+    std::memcpy(output, input, sizeof(float) * available);
+    std::fill(output + available, output + columnCount_, 0.0f);
+    return;
+  }
+  for (size_t c = 0; c < columnCount_; ++c) {
+    const size_t begin = std::min<size_t>(columnBegin_[c], available);
+    const size_t end = std::min<size_t>(columnEnd_[c], available);
+    float peak = 0.0f;
+    for (size_t bin = begin; bin < end; ++bin) {
+      peak = std::max(peak, input[bin]);
+    }
+    output[c] = peak;
+  }
+}
+
+}  // namespace uvk
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace uvk {
+
+struct BinAggregationOptions {
+  // Output columns per waterfall row; 0 keeps one column per input bin.
+  size_t columns{0};
+  // Space columns logarithmically from bin 1 (DC is dropped) up to the Nyquist bin.
+  bool logFrequency{false};
+};
+
+// Reduces a spectrum row to a fixed number of display columns before it is stored and
+// uploaded. Each column is the maximum of the bins it covers, so narrow peaks survive the
+// reduction; on a log axis, low columns narrower than one bin repeat that bin.
+class BinAggregator {
+ public:
+  void configure(size_t inputBins, const BinAggregationOptions& options);
+
+  // Writes columnCount() values to `output`. Bins missing from a short `input` read as 0.
+  void aggregate(const float* input, size_t inputCount, float* output) const;
+
+  [[nodiscard]] size_t inputBins() const noexcept { return inputBins_; }
+  [[nodiscard]] size_t columnCount() const noexcept { return columnCount_; }
+  [[nodiscard]] bool logFrequency() const noexcept { return logFrequency_; }
+  // True when aggregate() is a plain copy.
+  [[nodiscard]] bool passthrough() const noexcept { return passthrough_; }
+
+ private:
+  size_t inputBins_{};
+  size_t columnCount_{};
+  bool logFrequency_{false};
+  bool passthrough_{true};
+  // Column c covers input bins [columnBegin_[c], columnEnd_[c]).
+  std::vector<uint32_t> columnBegin_;
+  std::vector<uint32_t> columnEnd_;
+};
+
+}  // namespace uvk
@@ -2,53 +2,372 @@
 
 #include <algorithm>
 #include <cmath>
+#include <functional>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 namespace uvk {
 
-DifferentialBounds DifferentialMath::analyzeWaterfall(const std::vector<float>& waterfall,
-                                                      size_t binCount, size_t historyLength,
-                                                      bool includeBatch) {
-  DifferentialBounds result{};
-  if (waterfall.empty() || binCount == 0 || historyLength == 0) {
-    return result;
+namespace {
+
+// Below this many samples a scan is not worth splitting across tasks.
+constexpr size_t kParallelScanSamples = size_t{1} << 16;
+
+struct SpanSums {
+  float sum{};
+  float absSum{};
+  // Sum of current - previous.
+  float diffSum{};
+  float min{};
+  float max{};
+};
+
+// One pass over `count` >= 1 samples with no data-dependent branches; SSE lanes carry
+// independent partial sums that are folded at the end.
+SpanSums sumSpan(const float* current, const float* previous, size_t count) {
+  SpanSums sums{};
+  sums.min = current[0];
+  sums.max = current[0];
+  size_t i = 0;
+#if defined(__SSE2__)
+  if (count >= 4) {
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 sum = _mm_setzero_ps();
+    __m128 absSum = _mm_setzero_ps();
+    __m128 diffSum = _mm_setzero_ps();
+    __m128 minimum = _mm_set1_ps(current[0]);
+    __m128 maximum = minimum;
+    for (; i + 4 <= count; i += 4) {
+      const __m128 value = _mm_loadu_ps(current + i);
+      sum = _mm_add_ps(sum, value);
+      absSum = _mm_add_ps(absSum, _mm_and_ps(value, absMask));
+      diffSum = _mm_add_ps(diffSum, _mm_sub_ps(value, _mm_loadu_ps(previous + i)));
+      minimum = _mm_min_ps(minimum, value);
+      maximum = _mm_max_ps(maximum, value);
+    }
+    alignas(16) float lanes[5][4];
+    _mm_store_ps(lanes[0], sum);
+    _mm_store_ps(lanes[1], absSum);
+    _mm_store_ps(lanes[2], diffSum);
+    _mm_store_ps(lanes[3], minimum);
+    _mm_store_ps(lanes[4], maximum);
+    for (size_t lane = 0; lane < 4; ++lane) {
+      sums.sum += lanes[0][lane];
+      sums.absSum += lanes[1][lane];
+      sums.diffSum += lanes[2][lane];
+      sums.min = std::min(sums.min, lanes[3][lane]);
+      sums.max = std::max(sums.max, lanes[4][lane]);
+    }
+  }
+#endif
+  for (; i < count; ++i) {
+    sums.sum += current[i];
+    sums.absSum += std::abs(current[i]);
+    sums.diffSum += current[i] - previous[i];
+    sums.min = std::min(sums.min, current[i]);
+    sums.max = std::max(sums.max, current[i]);
   }
+  return sums;
+}
+
+// Partial results for a block of logical rows; blocks are merged in order, so the result does
+// not depend on the number of tasks.
+struct ScanPartial {
+  float min{};
+  float max{};
+  double dx{};
+  double dy{};
+  double dz{};
+  std::vector<double> bandSums;
+  std::vector<double> bandDiffs;
+};
+
+// Returns physical row `row` as binCount floats: either a pointer into a plain float history
+// or `scratch`, which holds binCount floats, after decoding into it.
+using RowSource = std::function<const float*(size_t row, float* scratch)>;
 
+WaterfallStatistics scanHistory(const RowSource& source, size_t binCount, size_t historyLength,
+                                size_t headRow, size_t bandCount,
+                                EnkiTaskScheduler* scheduler) {
+  WaterfallStatistics result;
+  if (binCount == 0 || historyLength == 0) {
+    return result;
+  }
   const size_t totalSize = binCount * historyLength;
-  const size_t size = std::min(totalSize, waterfall.size());
-  float minValue = waterfall.front();
-  float maxValue = waterfall.front();
 
-  for (size_t i = 0; i < size; ++i) {
-    minValue = std::min(minValue, waterfall[i]);
-    maxValue = std::max(maxValue, waterfall[i]);
+  bandCount = std::clamp<size_t>(bandCount, 1, binCount);
+  std::vector<size_t> bandEdges(bandCount + 1);
+  for (size_t band = 0; band <= bandCount; ++band) {
+    bandEdges[band] = band * binCount / bandCount;
   }
+  result.rowMaxima.assign(historyLength, 0.0f);
+  const auto rowAt = [&](size_t logical, float* scratch) {
+    return source((headRow + logical) % historyLength, scratch);
+  };
 
-  result.bounds.min = {0.0f, minValue, 0.0f};
-  result.bounds.max = {static_cast<float>(binCount - 1), maxValue,
+  const auto scanRows = [&](size_t rowBegin, size_t rowEnd, ScanPartial& partial) {
+    partial.bandSums.assign(bandCount, 0.0);
+    partial.bandDiffs.assign(bandCount, 0.0);
+    // Each task decodes into its own pair of rows, swapped as it steps to the next row.
+    std::vector<float> scratch(2 * binCount);
+    float* currentScratch = scratch.data();
+    float* previousScratch = scratch.data() + binCount;
+    const float* previous = rowBegin > 0 ? rowAt(rowBegin - 1, previousScratch) : nullptr;
+    for (size_t row = rowBegin; row < rowEnd; ++row) {
+      const float* current = rowAt(row, currentScratch);
+      if (row == rowBegin) {
+        partial.min = current[0];
+        partial.max = current[0];
+      }
+      // The newest row is compared with itself, so its differences are all zero.
+      if (row == 0) {
+        previous = current;
+      }
+      float rowMax = current[0];
+      float absSum = 0.0f;
+      float diffSum = 0.0f;
+      for (size_t band = 0; band < bandCount; ++band) {
+        const size_t begin = bandEdges[band];
+        const SpanSums sums =
+            sumSpan(current + begin, previous + begin, bandEdges[band + 1] - begin);
+        partial.bandSums[band] += sums.sum;
+        partial.bandDiffs[band] += sums.diffSum;
+        absSum += sums.absSum;
+        diffSum += sums.diffSum;
+        partial.min = std::min(partial.min, sums.min);
+        rowMax = std::max(rowMax, sums.max);
+      }
+      partial.max = std::max(partial.max, rowMax);
+      result.rowMaxima[row] = rowMax;
+      if (row > 0) {
+        // Column 0 has no left neighbour and is left out of the gradients; dx telescopes to
+        // the row's last sample minus its first.
+        partial.dx += current[binCount - 1] - current[0];
+        partial.dy += absSum - std::abs(current[0]);
+        partial.dz += diffSum - (current[0] - previous[0]);
+      }
+      previous = current;
+      std::swap(currentScratch, previousScratch);
+    }
+  };
+
+  size_t taskCount = 1;
+  if (scheduler && scheduler->threadCount() > 1 && totalSize >= kParallelScanSamples) {
+    taskCount = std::min(scheduler->threadCount(), historyLength);
+  }
+  std::vector<ScanPartial> partials(taskCount);
+  const size_t rowsPerTask = historyLength / taskCount;
+  const auto blockBegin = [&](size_t task) {
+    return task == taskCount ? historyLength : task * rowsPerTask;
+  };
+  if (taskCount > 1) {
+    std::vector<std::future<void>> tasks;
+    for (size_t task = 0; task < taskCount; ++task) {
+      tasks.emplace_back(scheduler->addTask([&, task]() {
+        scanRows(blockBegin(task), blockBegin(task + 1), partials[task]);
+      }));
+    }
+    scheduler->waitAll(tasks);
+  } else {
+    scanRows(0, historyLength, partials[0]);
+  }
+
+  ScanPartial total = partials[0];
+  for (size_t task = 1; task < taskCount; ++task) {
+    const ScanPartial& partial = partials[task];
+    total.min = std::min(total.min, partial.min);
+    total.max = std::max(total.max, partial.max);
+    total.dx += partial.dx;
+    total.dy += partial.dy;
+    total.dz += partial.dz;
+    for (size_t band = 0; band < bandCount; ++band) {
+      total.bandSums[band] += partial.bandSums[band];
+      total.bandDiffs[band] += partial.bandDiffs[band];
+    }
+  }
+
+  DifferentialBounds& bounds = result.differential;
+  bounds.bounds.min = {0.0f, total.min, 0.0f};
+  bounds.bounds.max = {static_cast<float>(binCount - 1), total.max,
                        static_cast<float>(historyLength - 1)};
+  const float denom = static_cast<float>((historyLength - 1) * (binCount - 1));
+  bounds.gradient = {static_cast<float>(total.dx) / denom, static_cast<float>(total.dy) / denom,
+                     static_cast<float>(total.dz) / denom};
 
+  result.bandMeans.resize(bandCount);
+  result.bandGradients.resize(bandCount);
+  for (size_t band = 0; band < bandCount; ++band) {
+    const double width = static_cast<double>(bandEdges[band + 1] - bandEdges[band]);
+    result.bandMeans[band] =
+        static_cast<float>(total.bandSums[band] / (width * static_cast<double>(historyLength)));
+    result.bandGradients[band] =
+        historyLength > 1 ? static_cast<float>(total.bandDiffs[band] /
+                                               (width * static_cast<double>(historyLength - 1)))
+                          : 0.0f;
+  }
+  return result;
+}
+
+
+// The original per-sample scan, kept for buffers shorter than the history: samples past the
+// end of the buffer are skipped rather than read as zeros, so they do not widen the bounds.
+DifferentialBounds analyzePartialWaterfall(const std::vector<float>& waterfall, size_t binCount,
+                                           size_t historyLength, bool includeBatch,
+                                           size_t headRow) {
+  DifferentialBounds result{};
+  const size_t size = waterfall.size();
+  const auto [minValue, maxValue] = std::minmax_element(waterfall.begin(), waterfall.end());
+  result.bounds.min = {0.0f, *minValue, 0.0f};
+  result.bounds.max = {static_cast<float>(binCount - 1), *maxValue,
+                       static_cast<float>(historyLength - 1)};
   if (includeBatch) {
     float dx = 0.0f;
     float dz = 0.0f;
     float dy = 0.0f;
     for (size_t row = 1; row < historyLength; ++row) {
+      const size_t rowStart = ((headRow + row) % historyLength) * binCount;
+      const size_t prevRowStart = ((headRow + row - 1) % historyLength) * binCount;
       for (size_t col = 1; col < binCount; ++col) {
-        const size_t index = row * binCount + col;
-        if (index >= size) {
+        const size_t index = rowStart + col;
+        if (index >= size || prevRowStart + col >= size) {
           continue;
         }
-        const float current = waterfall[index];
-        const float left = waterfall[index - 1];
-        const float prevRow = waterfall[index - binCount];
-        dx += current - left;
-        dz += current - prevRow;
-        dy += std::abs(current);
+        dx += waterfall[index] - waterfall[index - 1];
+        dz += waterfall[index] - waterfall[prevRowStart + col];
+        dy += std::abs(waterfall[index]);
       }
     }
     const float denom = static_cast<float>((historyLength - 1) * (binCount - 1));
     result.gradient = {dx / denom, dy / denom, dz / denom};
   }
+  return result;
+}
+
+}  // namespace
+
+DifferentialBounds DifferentialMath::analyzeWaterfall(const std::vector<float>& waterfall,
+                                                      size_t binCount, size_t historyLength,
+                                                      bool includeBatch, size_t headRow) {
+  if (waterfall.empty() || binCount == 0 || historyLength == 0) {
+    return {};
+  }
+  if (waterfall.size() < binCount * historyLength) {
+    return analyzePartialWaterfall(waterfall, binCount, historyLength, includeBatch, headRow);
+  }
+  DifferentialBounds result =
+      scanWaterfall(waterfall, binCount, historyLength, headRow, 1, nullptr).differential;
+  if (!includeBatch) {
+    result.gradient = {};
+  }
+  return result;
+}
+
+WaterfallStatistics DifferentialMath::scanWaterfall(const std::vector<float>& waterfall,
+                                                    size_t binCount, size_t historyLength,
+                                                    size_t headRow, size_t bandCount,
+                                                    EnkiTaskScheduler* scheduler) {
+  const size_t totalSize = binCount * historyLength;
+  std::vector<float> padded;
+  const float* samples = waterfall.data();
+  if (waterfall.size() < totalSize) {
+    padded.assign(totalSize, 0.0f);
+    std::copy(waterfall.begin(), waterfall.end(), padded.begin());
+    samples = padded.data();
+  }
+  return scanHistory(
+      [samples, binCount](size_t row, float*) { return samples + row * binCount; }, binCount,
+      historyLength, headRow, bandCount, scheduler);
+}
+
+WaterfallStatistics DifferentialMath::scanRows(const RowReader& readRow, size_t binCount,
+                                               size_t historyLength, size_t headRow,
+                                               size_t bandCount, EnkiTaskScheduler* scheduler) {
+  if (!readRow) {
+    return {};
+  }
+  return scanHistory(
+      [&readRow](size_t row, float* scratch) {
+        readRow(row, scratch);
+        return static_cast<const float*>(scratch);
+      },
+      binCount, historyLength, headRow, bandCount, scheduler);
+}
+
+DifferentialBounds DifferentialMath::analyzeRows(const RowReader& readRow, size_t binCount,
+                                                 size_t historyLength, bool includeBatch,
+                                                 size_t headRow) {
+  DifferentialBounds result =
+      scanRows(readRow, binCount, historyLength, headRow, 1, nullptr).differential;
+  if (!includeBatch) {
+    result.gradient = {};
+  }
+  return result;
+}
+
+void SlidingDifferential::reset(size_t binCount, size_t rowCount) {
+  binCount_ = binCount;
+  rowCount_ = rowCount;
+  terms_.assign(rowCount, RowTerms{});
+  edgeSum_ = 0.0;
+  magnitudeSum_ = 0.0;
+  minTree_.assign(rowCount * 2, 0.0f);
+  maxTree_.assign(rowCount * 2, 0.0f);
+}
+
+void SlidingDifferential::replaceRow(size_t row, const float* values) {
+  if (row >= rowCount_ || binCount_ == 0) {
+    return;
+  }
+  RowTerms terms;
+  terms.edge = static_cast<double>(values[binCount_ - 1]) - values[0];
+  float magnitude = 0.0f;
+  float interior = 0.0f;
+  float minValue = values[0];
+  float maxValue = values[0];
+  for (size_t col = 1; col < binCount_; ++col) {
+    magnitude += std::abs(values[col]);
+    interior += values[col];
+    minValue = std::min(minValue, values[col]);
+    maxValue = std::max(maxValue, values[col]);
+  }
+  terms.magnitude = magnitude;
+  terms.interior = interior;
+  // Subtract the evicted row's share and add the new one.
+  edgeSum_ += terms.edge - terms_[row].edge;
+  magnitudeSum_ += terms.magnitude - terms_[row].magnitude;
+  terms_[row] = terms;
 
+  size_t node = rowCount_ + row;
+  minTree_[node] = minValue;
+  maxTree_[node] = maxValue;
+  for (node /= 2; node >= 1; node /= 2) {
+    minTree_[node] = std::min(minTree_[2 * node], minTree_[2 * node + 1]);
+    maxTree_[node] = std::max(maxTree_[2 * node], maxTree_[2 * node + 1]);
+  }
+}
+
+DifferentialBounds SlidingDifferential::bounds(size_t newestRow, size_t oldestRow,
+                                               bool includeBatch) const {
+  DifferentialBounds result{};
+  if (binCount_ == 0 || rowCount_ == 0) {
+    return result;
+  }
+  // Every node has its parent at node / 2, so node 1 aggregates all rows for any rowCount_
+  // (with a single row it is that row's leaf).
+  result.bounds.min = {0.0f, minTree_[1], 0.0f};
+  result.bounds.max = {static_cast<float>(binCount_ - 1), maxTree_[1],
+                       static_cast<float>(rowCount_ - 1)};
+  if (includeBatch) {
+    const RowTerms& newest = terms_[newestRow];
+    const double dx = edgeSum_ - newest.edge;
+    const double dy = magnitudeSum_ - newest.magnitude;
+    const double dz = terms_[oldestRow].interior - newest.interior;
+    const float denom = static_cast<float>((rowCount_ - 1) * (binCount_ - 1));
+    result.gradient = {static_cast<float>(dx) / denom, static_cast<float>(dy) / denom,
+                       static_cast<float>(dz) / denom};
+  }
   return result;
 }
 
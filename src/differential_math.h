@@ -1,6 +1,10 @@
 #pragma once
 
+#include "enki_ts.h"
+
 #include <array>
+#include <cstddef>
+#include <functional>
 #include <vector>
 
 namespace uvk {
@@ -15,11 +19,80 @@ struct DifferentialBounds {
   std::array<float, 3> gradient{};
 };
 
+// Everything one full pass over the history produces, so consumers such as auto-scaling or
+// anomaly detection need no pass of their own.
+struct WaterfallStatistics {
+  DifferentialBounds differential;
+  // Largest sample of each logical row, newest first.
+  std::vector<float> rowMaxima;
+  // Columns split into equal bands: the mean sample of each band over the whole history, and
+  // its mean change per row with the dz sign convention (older row minus newer row).
+  std::vector<float> bandMeans;
+  std::vector<float> bandGradients;
+};
+
 class DifferentialMath {
  public:
+  // A buffer shorter than binCount * historyLength only counts the samples it holds.
   static DifferentialBounds analyzeWaterfall(const std::vector<float>& waterfall,
                                              size_t binCount, size_t historyLength,
-                                             bool includeBatch);
+                                             bool includeBatch, size_t headRow = 0);
+
+  // analyzeWaterfall() plus per-row and per-band statistics, in one branch-free, vectorized
+  // pass. Blocks of rows are scanned in parallel when a scheduler with several threads is
+  // given. A buffer shorter than binCount * historyLength reads as zero-padded.
+  static WaterfallStatistics scanWaterfall(const std::vector<float>& waterfall, size_t binCount,
+                                           size_t historyLength, size_t headRow,
+                                           size_t bandCount, EnkiTaskScheduler* scheduler);
+
+  // Expands physical row `row` of a history not stored as plain floats to binCount floats.
+  using RowReader = std::function<void(size_t row, float* output)>;
+
+  // scanWaterfall() over rows decoded by `readRow`. Each task holds two decoded rows at a
+  // time, so with a scheduler `readRow` must be safe to call from several threads at once.
+  static WaterfallStatistics scanRows(const RowReader& readRow, size_t binCount,
+                                      size_t historyLength, size_t headRow, size_t bandCount,
+                                      EnkiTaskScheduler* scheduler);
+
+  // The differential part of scanRows(), on the calling thread.
+  static DifferentialBounds analyzeRows(const RowReader& readRow, size_t binCount,
+                                        size_t historyLength, bool includeBatch,
+                                        size_t headRow = 0);
+};
+
+// Keeps analyzeRows() current for a history that changes a row at a time. Every row's share of
+// the gradient sums and its extrema are cached, so replacing a row costs O(binCount + log rows)
+// instead of a rescan of binCount * rows samples.
+class SlidingDifferential {
+ public:
+  // Starts from rowCount rows of zeros, matching freshly cleared waterfall storage.
+  void reset(size_t binCount, size_t rowCount);
+  // `values` holds binCount floats for physical row `row`.
+  void replaceRow(size_t row, const float* values);
+  // Logical order only matters through its two ends: dx and dy skip the newest row, and dz
+  // telescopes to the oldest row minus the newest.
+  [[nodiscard]] DifferentialBounds bounds(size_t newestRow, size_t oldestRow,
+                                          bool includeBatch) const;
+
+ private:
+  struct RowTerms {
+    // row[last] - row[0], i.e. the row's summed dx.
+    double edge{};
+    // Sums of |row[col]| and row[col] over col >= 1.
+    double magnitude{};
+    double interior{};
+  };
+
+  size_t binCount_{};
+  size_t rowCount_{};
+  std::vector<RowTerms> terms_;
+  // Running sums are kept in double so hours of add/subtract do not drift visibly.
+  double edgeSum_{};
+  double magnitudeSum_{};
+  // Bottom-up segment trees over row extrema; leaves live at [rowCount_, 2 * rowCount_) and
+  // node 1 covers every row.
+  std::vector<float> minTree_;
+  std::vector<float> maxTree_;
 };
 
 }  // namespace uvk
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "profiler.h"
+
+#include <atomic>
 #include <future>
 #include <thread>
 #include <vector>
@@ -14,6 +17,20 @@ class EnkiTaskScheduler {
 
   template <typename Func>
   std::future<void> addTask(Func&& func) {
+#if defined(UVK_ENABLE_PROFILER)
+    if (Profiler::instance().enabled()) {
+      // Timed on the thread that runs it, so a trace shows where each task ran.
+      // Counted whether or not tracing is on, so the count stays balanced when tracing starts
+      // or stops while the task runs; only the sample depends on tracing.
+      const size_t pending = pending_.fetch_add(1, std::memory_order_relaxed) + 1;
+      UVK_PROFILE_COUNTER(TasksPending, pending);
+      return std::async(std::launch::async, [this, task = std::forward<Func>(func)]() mutable {
+        const PendingTask pending{pending_};
+        UVK_PROFILE_SCOPE(Task);
+        task();
+      });
+    }
+#endif
     return std::async(std::launch::async, std::forward<Func>(func));
   }
 
@@ -26,7 +43,17 @@ class EnkiTaskScheduler {
   [[nodiscard]] size_t threadCount() const noexcept { return threadCount_; }
 
  private:
+  // Counts a profiled task down when it finishes, even by throwing.
+  struct PendingTask {
+    std::atomic<size_t>& pending;
+    ~PendingTask() {
+      [[maybe_unused]] const size_t remaining = pending.fetch_sub(1, std::memory_order_relaxed) - 1;
+      UVK_PROFILE_COUNTER(TasksPending, remaining);
+    }
+  };
+
   size_t threadCount_{1};
+  std::atomic<size_t> pending_{0};
 };
 
 }  // namespace uvk
@@ -0,0 +1,297 @@
+#include "file_capture.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace uvk {
+
+namespace {
+
+uint16_t readLe16(const unsigned char* bytes) {
+  return static_cast<uint16_t>(bytes[0] | (bytes[1] << 8));
+}
+
+uint32_t readLe32(const unsigned char* bytes) {
+  return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+         (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+constexpr uint16_t kWaveFormatPcm = 1;
+constexpr uint16_t kWaveFormatFloat = 3;
+constexpr uint16_t kWaveFormatExtensible = 0xFFFE;
+
+}  // namespace
+
+struct FileCapture::Mapping {
+  const unsigned char* base{nullptr};
+  size_t size{};
+#ifdef _WIN32
+  HANDLE file{INVALID_HANDLE_VALUE};
+  HANDLE mapping{nullptr};
+#else
+  int fd{-1};
+#endif
+
+  ~Mapping() {
+#ifdef _WIN32
+    if (base) {
+      UnmapViewOfFile(base);
+    }
+    if (mapping) {
+      CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+      CloseHandle(file);
+    }
+#else
+    if (base) {
+      munmap(const_cast<unsigned char*>(base), size);
+    }
+    if (fd >= 0) {
+      ::close(fd);
+    }
+#endif
+  }
+
+  void map(const std::string& path) {
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                       FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+      throw std::runtime_error("Failed to open capture file: " + path);
+    }
+    LARGE_INTEGER fileSize{};
+    if (!GetFileSizeEx(file, &fileSize)) {
+      throw std::runtime_error("Failed to query capture file size: " + path);
+    }
+    size = static_cast<size_t>(fileSize.QuadPart);
+    if (size == 0) {
+      return;
+    }
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+      throw std::runtime_error("Failed to map capture file: " + path);
+    }
+    base = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!base) {
+      throw std::runtime_error("Failed to map capture file: " + path);
+    }
+#else
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Failed to open capture file: " + path);
+    }
+    struct stat info {};
+    if (fstat(fd, &info) != 0) {
+      throw std::runtime_error("Failed to query capture file size: " + path);
+    }
+    size = static_cast<size_t>(info.st_size);
+    if (size == 0) {
+      return;
+    }
+    void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+      throw std::runtime_error("Failed to map capture file: " + path);
+    }
+    madvise(address, size, MADV_SEQUENTIAL);
+    base = static_cast<const unsigned char*>(address);
+#endif
+  }
+};
+
+FileCapture::FileCapture() = default;
+
+FileCapture::~FileCapture() {
+  close();
+}
+
+void FileCapture::open(const FileCaptureOptions& options) {
+  close();
+  auto mapping = std::make_unique<Mapping>();
+  mapping->map(options.path);
+  if (!mapping->base) {
+    throw std::runtime_error("Capture file is empty: " + options.path);
+  }
+
+  try {
+    if (!parseWaveHeader(mapping->base, mapping->size)) {
+      if (options.rawChannels <= 0 || options.rawSampleRate <= 0.0f) {
+        throw std::runtime_error("Raw capture files need a channel count and sample rate.");
+      }
+      data_ = mapping->base;
+      format_ = options.rawFormat;
+      channels_ = options.rawChannels;
+      sampleRate_ = options.rawSampleRate;
+      frameBytes_ = pcmBytesPerSample(format_) * static_cast<size_t>(channels_);
+      frameCount_ = mapping->size / frameBytes_;
+    }
+    if (frameCount_ == 0) {
+      throw std::runtime_error("Capture file has no audio frames: " + options.path);
+    }
+  } catch (...) {
+    close();
+    throw;
+  }
+
+  mapping_ = std::move(mapping);
+  realtime_ = options.realtime;
+  loop_ = options.loop;
+  rewind();
+}
+
+void FileCapture::close() {
+  mapping_.reset();
+  data_ = nullptr;
+  frameCount_ = 0;
+  frameBytes_ = 0;
+  position_ = 0;
+  framesServed_ = 0;
+}
+
+void FileCapture::rewind() {
+  position_ = 0;
+  framesServed_ = 0;
+  paceStart_ = std::chrono::steady_clock::now();
+}
+
+bool FileCapture::parseWaveHeader(const unsigned char* bytes, size_t size) {
+  if (size < 12 || std::memcmp(bytes, "RIFF", 4) != 0 || std::memcmp(bytes + 8, "WAVE", 4) != 0) {
+    return false;
+  }
+
+  bool haveFormat = false;
+  size_t offset = 12;
+  while (offset + 8 <= size) {
+    const unsigned char* chunk = bytes + offset;
+    const size_t chunkSize = readLe32(chunk + 4);
+    const size_t body = offset + 8;
+
+    if (std::memcmp(chunk, "fmt ", 4) == 0) {
+      if (chunkSize < 16 || body + 16 > size) {
+        throw std::runtime_error("Malformed WAV format chunk.");
+      }
+      uint16_t formatTag = readLe16(bytes + body);
+      const uint16_t channels = readLe16(bytes + body + 2);
+      const uint32_t sampleRate = readLe32(bytes + body + 4);
+      const uint16_t bitsPerSample = readLe16(bytes + body + 14);
+      if (formatTag == kWaveFormatExtensible && chunkSize >= 40 && body + 26 <= size) {
+        formatTag = readLe16(bytes + body + 24);
+      }
+
+      if (formatTag == kWaveFormatPcm && bitsPerSample == 16) {
+        format_ = PcmFormat::Int16;
+      } else if (formatTag == kWaveFormatPcm && bitsPerSample == 24) {
+        format_ = PcmFormat::Int24;
+      } else if (formatTag == kWaveFormatPcm && bitsPerSample == 32) {
+        format_ = PcmFormat::Int32;
+      } else if (formatTag == kWaveFormatFloat && bitsPerSample == 32) {
+        format_ = PcmFormat::Float32;
+      } else {
+        throw std::runtime_error("Unsupported WAV sample format.");
+      }
+      if (channels == 0 || sampleRate == 0) {
+        throw std::runtime_error("WAV file declares no channels or sample rate.");
+      }
+      channels_ = channels;
+      sampleRate_ = static_cast<float>(sampleRate);
+      frameBytes_ = pcmBytesPerSample(format_) * static_cast<size_t>(channels_);
+      haveFormat = true;
+    } else if (std::memcmp(chunk, "data", 4) == 0) {
+      if (!haveFormat) {
+        throw std::runtime_error("WAV data chunk precedes its format chunk.");
+      }
+      // Streaming writers leave the size at 0 or 0xFFFFFFFF; trust the file length instead.
+      const size_t available = size - std::min(size, body);
+      const size_t dataSize = (chunkSize == 0 || chunkSize == 0xFFFFFFFFu)
+                                  ? available
+                                  : std::min(chunkSize, available);
+      data_ = bytes + body;
+      frameCount_ = dataSize / frameBytes_;
+      return true;
+    }
+    offset = body + chunkSize + (chunkSize & 1u);
+  }
+  throw std::runtime_error("WAV file has no data chunk.");
+}
+
+void FileCapture::decodeRange(size_t frameOffset, size_t frameCount,
+                              std::array<float, 8>* destination) const {
+  decodePcmFrames(data_ + frameOffset * frameBytes_, frameCount, channels_, format_, destination);
+}
+
+void FileCapture::pace(size_t blockFrames) {
+  framesServed_ += blockFrames;
+  if (!realtime_ || sampleRate_ <= 0.0f) {
+    return;
+  }
+  // A block becomes "available" once its last frame would have arrived from the device.
+  const auto due = paceStart_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                    std::chrono::duration<double>(
+                                        static_cast<double>(framesServed_) / sampleRate_));
+  std::this_thread::sleep_until(due);
+}
+
+SurroundBlock FileCapture::nextBlock(int blockSize) {
+  SurroundBlock block;
+  block.sampleRate = sampleRate_;
+  block.timestampSeconds =
+      sampleRate_ > 0.0f ? static_cast<double>(position_) / sampleRate_ : 0.0;
+  if (!data_ || blockSize <= 0 || exhausted()) {
+    return block;
+  }
+
+  const size_t requested = static_cast<size_t>(blockSize);
+  if (!loop_) {
+    const size_t count = std::min(requested, frameCount_ - position_);
+    block.samples.resize(count);
+    decodeRange(position_, count, block.samples.data());
+    position_ += count;
+    pace(count);
+    return block;
+  }
+
+  block.samples.resize(requested);
+  size_t written = 0;
+  while (written < requested) {
+    if (position_ >= frameCount_) {
+      position_ = 0;
+    }
+    const size_t count = std::min(requested - written, frameCount_ - position_);
+    decodeRange(position_, count, block.samples.data() + written);
+    position_ += count;
+    written += count;
+  }
+  pace(requested);
+  return block;
+}
+
+SurroundBlock FileCapture::readBlock(size_t frameOffset, size_t frameCount) const {
+  SurroundBlock block;
+  block.sampleRate = sampleRate_;
+  block.timestampSeconds =
+      sampleRate_ > 0.0f ? static_cast<double>(frameOffset) / sampleRate_ : 0.0;
+  if (!data_ || frameOffset >= frameCount_) {
+    return block;
+  }
+  const size_t count = std::min(frameCount, frameCount_ - frameOffset);
+  block.samples.resize(count);
+  decodeRange(frameOffset, count, block.samples.data());
+  return block;
+}
+
+}  // namespace uvk
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "audio_stream.h"
+#include "pcm_format.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace uvk {
+
+struct FileCaptureOptions {
+  std::string path;
+  bool realtime{true};
+  bool loop{false};
+  // Only used for headerless raw files; WAV files carry their own format.
+  PcmFormat rawFormat{PcmFormat::Float32};
+  int rawChannels{8};
+  float rawSampleRate{48000.0f};
+};
+
+// Serves SurroundBlocks from a memory-mapped WAV or raw interleaved PCM file. Samples are
+// decoded straight from the mapping into the block, so no intermediate read buffer is used.
+class FileCapture {
+ public:
+  FileCapture();
+  ~FileCapture();
+
+  FileCapture(const FileCapture&) = delete;
+  FileCapture& operator=(const FileCapture&) = delete;
+
+  void open(const FileCaptureOptions& options);
+  void close();
+  void rewind();
+
+  SurroundBlock nextBlock(int blockSize);
+  // Random access decode that ignores pacing and the playback cursor.
+  SurroundBlock readBlock(size_t frameOffset, size_t frameCount) const;
+
+  [[nodiscard]] bool isOpen() const noexcept { return data_ != nullptr; }
+  [[nodiscard]] bool exhausted() const noexcept { return !loop_ && position_ >= frameCount_; }
+  [[nodiscard]] size_t frameCount() const noexcept { return frameCount_; }
+  [[nodiscard]] float sampleRate() const noexcept { return sampleRate_; }
+  [[nodiscard]] int channels() const noexcept { return channels_; }
+  [[nodiscard]] PcmFormat format() const noexcept { return format_; }
+
+ private:
+  struct Mapping;
+
+  bool parseWaveHeader(const unsigned char* bytes, size_t size);
+  void decodeRange(size_t frameOffset, size_t frameCount, std::array<float, 8>* destination) const;
+  void pace(size_t blockFrames);
+
+  std::unique_ptr<Mapping> mapping_;
+  const unsigned char* data_{nullptr};
+  size_t frameCount_{};
+  size_t frameBytes_{};
+  float sampleRate_{};
+  int channels_{};
+  PcmFormat format_{PcmFormat::Float32};
+  bool realtime_{true};
+  bool loop_{false};
+  size_t position_{};
+  size_t framesServed_{};
+  std::chrono::steady_clock::time_point paceStart_{};
+};
+
+}  // namespace uvk
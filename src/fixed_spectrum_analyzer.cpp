@@ -0,0 +1,39 @@
+#include "fixed_spectrum_analyzer.h"
+
+#include "visualizer_presets.h"
+
+#include <algorithm>
+
+namespace uvk {
+
+namespace {
+
+constexpr size_t kSurroundChannels = 8;
+
+template <size_t FftSize, const auto& BandEdgesHz>
+constexpr FixedSpectrumKernel makeKernel() {
+  return {static_cast<int>(FftSize), BandEdgesHz.data(), BandEdgesHz.size(),
+          &FixedSpectrumAnalyzer<FftSize, kSurroundChannels, BandEdgesHz>::analyze};
+}
+
+// One entry per built-in preset in visualizer_presets.h.
+constexpr std::array<FixedSpectrumKernel, 3> kKernels{
+    makeKernel<512, kWidebandBandEdgesHz>(),
+    makeKernel<256, kSubwooferBandEdgesHz>(),
+    makeKernel<512, kPresenceBandEdgesHz>(),
+};
+
+}  // namespace
+
+const FixedSpectrumKernel* findFixedSpectrumKernel(
+    int fftSize, const std::vector<float>& bandEdgesHz) noexcept {
+  for (const auto& kernel : kKernels) {
+    if (kernel.fftSize == fftSize && kernel.bandEdgeCount == bandEdgesHz.size() &&
+        std::equal(bandEdgesHz.begin(), bandEdgesHz.end(), kernel.bandEdgesHz)) {
+      return &kernel;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace uvk
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "audio_stream.h"
+#include "enki_ts.h"
+#include "spectrum_analyzer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <vector>
+
+namespace uvk {
+
+namespace spectrum_detail {
+
+inline constexpr double kPi = 3.14159265358979323846;
+
+// std::sin is not constexpr before C++26. Arguments are reduced to [-pi, pi], where 24 Taylor
+// terms are exact to double precision, which is more than the float tables need.
+constexpr double constexprSin(double x) {
+  while (x > kPi) {
+    x -= 2.0 * kPi;
+  }
+  while (x < -kPi) {
+    x += 2.0 * kPi;
+  }
+  double term = x;
+  double sum = x;
+  for (int i = 1; i < 24; ++i) {
+    term *= -x * x / static_cast<double>((2 * i) * (2 * i + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr double constexprCos(double x) { return constexprSin(x + 0.5 * kPi); }
+
+// Hann window and twiddle factors for one transform size. The DFT term for bin k and sample n
+// uses twiddle (k * n) mod Size, so a single period of cos/sin serves every bin.
+template <size_t Size>
+struct SpectrumTables {
+  std::array<float, Size> window{};
+  std::array<float, Size> cosine{};
+  std::array<float, Size> sine{};
+};
+
+template <size_t Size>
+constexpr SpectrumTables<Size> makeSpectrumTables() {
+  SpectrumTables<Size> tables{};
+  for (size_t n = 0; n < Size; ++n) {
+    const double phase = static_cast<double>(n) / static_cast<double>(Size - 1);
+    tables.window[n] = static_cast<float>(0.5 - 0.5 * constexprCos(2.0 * kPi * phase));
+    const double angle = 2.0 * kPi * static_cast<double>(n) / static_cast<double>(Size);
+    tables.cosine[n] = static_cast<float>(constexprCos(angle));
+    tables.sine[n] = static_cast<float>(constexprSin(angle));
+  }
+  return tables;
+}
+
+template <size_t Size>
+inline constexpr SpectrumTables<Size> kSpectrumTables = makeSpectrumTables<Size>();
+
+// Band of each bin at `sampleRate`, or -1 outside every band. Bin frequencies are computed in
+// float exactly as SpectrumAnalyzer does, so both paths agree on the edges.
+template <size_t Size, const auto& BandEdgesHz>
+constexpr std::array<int8_t, Size / 2> makeBandIndex(float sampleRate) {
+  std::array<int8_t, Size / 2> index{};
+  for (size_t k = 0; k < Size / 2; ++k) {
+    const float freq = sampleRate * static_cast<float>(k) / static_cast<float>(Size);
+    index[k] = -1;
+    for (size_t band = 0; band + 1 < BandEdgesHz.size(); ++band) {
+      if (freq >= BandEdgesHz[band] && freq < BandEdgesHz[band + 1]) {
+        index[k] = static_cast<int8_t>(band);
+        break;
+      }
+    }
+  }
+  return index;
+}
+
+}  // namespace spectrum_detail
+
+// SpectrumAnalyzer specialized for one transform size, channel count and band table. The
+// window, twiddle and (for the nominal sample rate) band-index tables are built at compile
+// time, the window is applied once per block rather than once per bin, and the inner loop
+// has a fixed trip count. Results match the generic path to float rounding.
+template <size_t FftSize, size_t Channels, const auto& BandEdgesHz>
+class FixedSpectrumAnalyzer {
+ public:
+  static_assert(FftSize >= 2 && (FftSize & (FftSize - 1)) == 0,
+                "FFT size must be a power of two");
+  static_assert(Channels >= 1 &&
+                    Channels <= std::tuple_size_v<decltype(SurroundBlock::samples)::value_type>,
+                "Channel count exceeds the surround block");
+  static_assert(BandEdgesHz.size() >= 2 && BandEdgesHz.size() <= 128,
+                "Band table needs between 2 and 128 edges");
+
+  static constexpr size_t kBinCount = FftSize / 2;
+  static constexpr size_t kBandCount = BandEdgesHz.size() - 1;
+  static constexpr float kNominalSampleRate = 48000.0f;
+
+  // `block` must hold at least FftSize samples.
+  static SpectrumFrame analyze(const SurroundBlock& block, EnkiTaskScheduler* scheduler) {
+    constexpr const auto& tables = spectrum_detail::kSpectrumTables<FftSize>;
+
+    std::array<float, FftSize> windowed{};
+    for (size_t i = 0; i < FftSize; ++i) {
+      const auto& sample = block.samples[i];
+      float sum = 0.0f;
+      for (size_t channel = 0; channel < Channels; ++channel) {
+        sum += sample[channel];
+      }
+      windowed[i] = sum / static_cast<float>(Channels) * tables.window[i];
+    }
+
+    SpectrumFrame frame{};
+    frame.magnitudes.assign(kBinCount, 0.0f);
+    frame.frequenciesHz.assign(kBinCount, 0.0f);
+
+    if (scheduler && scheduler->threadCount() > 1) {
+      const size_t taskCount = scheduler->threadCount();
+      const size_t binsPerTask = std::max<size_t>(1, kBinCount / taskCount);
+      std::vector<std::future<void>> tasks;
+      for (size_t taskIndex = 0; taskIndex < taskCount; ++taskIndex) {
+        const size_t start = taskIndex * binsPerTask;
+        const size_t end = (taskIndex == taskCount - 1) ? kBinCount : start + binsPerTask;
+        if (start >= kBinCount) {
+          break;
+        }
+        tasks.emplace_back(scheduler->addTask(
+            [&, start, end]() { computeBins(windowed, start, end, frame.magnitudes); }));
+      }
+      scheduler->waitAll(tasks);
+    } else {
+      computeBins(windowed, 0, kBinCount, frame.magnitudes);
+    }
+
+    const float sampleRate = block.sampleRate > 0.0f ? block.sampleRate : kNominalSampleRate;
+    for (size_t k = 0; k < kBinCount; ++k) {
+      frame.frequenciesHz[k] = sampleRate * static_cast<float>(k) / static_cast<float>(FftSize);
+    }
+
+    frame.bandCentersHz.resize(kBandCount);
+    frame.bandEnergies.assign(kBandCount, 0.0f);
+    for (size_t band = 0; band < kBandCount; ++band) {
+      frame.bandCentersHz[band] = 0.5f * (BandEdgesHz[band] + BandEdgesHz[band + 1]);
+    }
+    if (sampleRate == kNominalSampleRate) {
+      for (size_t k = 0; k < kBinCount; ++k) {
+        if (kBandIndex[k] >= 0) {
+          frame.bandEnergies[static_cast<size_t>(kBandIndex[k])] += frame.magnitudes[k];
+        }
+      }
+    } else {
+      const auto bandIndex =
+          spectrum_detail::makeBandIndex<FftSize, BandEdgesHz>(sampleRate);
+      for (size_t k = 0; k < kBinCount; ++k) {
+        if (bandIndex[k] >= 0) {
+          frame.bandEnergies[static_cast<size_t>(bandIndex[k])] += frame.magnitudes[k];
+        }
+      }
+    }
+    return frame;
+  }
+
+ private:
+  static constexpr std::array<int8_t, kBinCount> kBandIndex =
+      spectrum_detail::makeBandIndex<FftSize, BandEdgesHz>(kNominalSampleRate);
+
+  static void computeBins(const std::array<float, FftSize>& windowed, size_t binStart,
+                          size_t binEnd, std::vector<float>& magnitudes) {
+    constexpr const auto& tables = spectrum_detail::kSpectrumTables<FftSize>;
+    for (size_t k = binStart; k < binEnd; ++k) {
+      float real = 0.0f;
+      float imag = 0.0f;
+      size_t twiddle = 0;
+      for (size_t n = 0; n < FftSize; ++n) {
+        real += windowed[n] * tables.cosine[twiddle];
+        imag -= windowed[n] * tables.sine[twiddle];
+        twiddle = (twiddle + k) & (FftSize - 1);
+      }
+      magnitudes[k] = std::sqrt(real * real + imag * imag) / static_cast<float>(FftSize);
+    }
+  }
+};
+
+// Ahead-of-time instantiation for one preset, looked up by SpectrumAnalyzer::analyze.
+struct FixedSpectrumKernel {
+  int fftSize;
+  const float* bandEdgesHz;
+  size_t bandEdgeCount;
+  SpectrumFrame (*analyze)(const SurroundBlock& block, EnkiTaskScheduler* scheduler);
+};
+
+// The kernel compiled for `fftSize` and `bandEdgesHz`, or nullptr for a custom preset.
+[[nodiscard]] const FixedSpectrumKernel* findFixedSpectrumKernel(
+    int fftSize, const std::vector<float>& bandEdgesHz) noexcept;
+
+}  // namespace uvk
@@ -0,0 +1,434 @@
+#include "gpu_allocator.h"
+
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+
+namespace uvk {
+
+namespace {
+
+constexpr VkDeviceSize kMinBuddySize = 256;
+constexpr VkDeviceSize kDefaultBlockSize = VkDeviceSize{64} << 20;
+constexpr VkDeviceSize kMinBlockSize = VkDeviceSize{1} << 20;
+constexpr VkDeviceSize kLinearBlockSize = VkDeviceSize{4} << 20;
+constexpr VkDeviceSize kPoolBlockSize = VkDeviceSize{1} << 20;
+constexpr VkDeviceSize kPoolMaxSlot = VkDeviceSize{64} << 10;
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+VkDeviceSize nextPowerOfTwo(VkDeviceSize value) {
+  VkDeviceSize result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+VkDeviceSize previousPowerOfTwo(VkDeviceSize value) {
+  VkDeviceSize result = 1;
+  while (result <= value / 2) {
+    result <<= 1;
+  }
+  return result;
+}
+
+uint32_t buddyOrder(VkDeviceSize size) {
+  uint32_t order = 0;
+  while ((kMinBuddySize << order) < size) {
+    ++order;
+  }
+  return order;
+}
+
+}  // namespace
+
+struct GpuAllocator::Block {
+  VkDeviceMemory memory{VK_NULL_HANDLE};
+  VkDeviceSize size{};
+  unsigned char* mapped{nullptr};
+  uint32_t memoryType{};
+  AllocationStrategy strategy{AllocationStrategy::Buddy};
+  bool dedicated{false};
+  size_t liveAllocations{};
+  VkDeviceSize usedBytes{};
+  // Linear: next free byte.
+  VkDeviceSize linearOffset{};
+  // Pool: slot size and free slot offsets.
+  VkDeviceSize slotSize{};
+  std::vector<VkDeviceSize> freeSlots;
+  // Buddy: free block offsets per order, where order k spans kMinBuddySize << k bytes.
+  std::vector<std::set<VkDeviceSize>> freeLists;
+};
+
+GpuAllocator::GpuAllocator() = default;
+
+GpuAllocator::~GpuAllocator() {
+  shutdown();
+}
+
+void GpuAllocator::initialize(VkPhysicalDevice physicalDevice, VkDevice device) {
+  shutdown();
+  device_ = device;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties_);
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  nonCoherentAtomSize_ = std::max<VkDeviceSize>(1, properties.limits.nonCoherentAtomSize);
+  maxAllocationCount_ = properties.limits.maxMemoryAllocationCount;
+}
+
+void GpuAllocator::shutdown() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (uint32_t i = 0; i < blocks_.size(); ++i) {
+    releaseBlock(i);
+  }
+  blocks_.clear();
+  bytesRequested_ = 0;
+  bytesAllocated_ = 0;
+  allocationCount_ = 0;
+}
+
+GpuAllocation GpuAllocator::allocate(const VkMemoryRequirements& requirements,
+                                     VkMemoryPropertyFlags properties,
+                                     AllocationStrategy strategy) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+  VkDeviceSize alignment = std::max<VkDeviceSize>(1, requirements.alignment);
+  VkDeviceSize size = requirements.size;
+  if (isHostVisible(memoryType)) {
+    alignment = std::max(alignment, nonCoherentAtomSize_);
+    size = alignUp(size, nonCoherentAtomSize_);
+  }
+
+  if (strategy == AllocationStrategy::Pool && std::max(size, alignment) > kPoolMaxSlot) {
+    strategy = AllocationStrategy::Buddy;
+  }
+  const VkDeviceSize slotSize = strategy == AllocationStrategy::Pool
+                                    ? nextPowerOfTwo(std::max({size, alignment, kMinBuddySize}))
+                                    : 0;
+  const bool dedicated = strategy == AllocationStrategy::Buddy &&
+                         nextPowerOfTwo(std::max(size, alignment)) > blockSizeFor(memoryType) / 2;
+
+  VkDeviceSize offset = 0;
+  VkDeviceSize reserved = 0;
+  uint32_t blockIndex = 0;
+  bool placed = false;
+  if (!dedicated) {
+    for (uint32_t i = 0; i < blocks_.size() && !placed; ++i) {
+      Block* block = blocks_[i].get();
+      if (block && !block->dedicated && block->memoryType == memoryType &&
+          block->strategy == strategy && block->slotSize == slotSize &&
+          allocateFrom(*block, size, alignment, &offset, &reserved)) {
+        blockIndex = i;
+        placed = true;
+      }
+    }
+  }
+  if (!placed) {
+    VkDeviceSize blockSize = size;
+    if (!dedicated) {
+      switch (strategy) {
+        case AllocationStrategy::Linear:
+          blockSize = std::max(kLinearBlockSize, alignUp(size, alignment));
+          break;
+        case AllocationStrategy::Pool:
+          blockSize = std::max(kPoolBlockSize, slotSize * 16);
+          break;
+        case AllocationStrategy::Buddy:
+          blockSize = blockSizeFor(memoryType);
+          break;
+      }
+    }
+    blockIndex = createBlock(memoryType, strategy, blockSize, slotSize, dedicated);
+    if (!allocateFrom(*blocks_[blockIndex], size, alignment, &offset, &reserved)) {
+      throw std::runtime_error("Failed to sub-allocate from a fresh Vulkan memory block.");
+    }
+  }
+
+  Block& block = *blocks_[blockIndex];
+  block.usedBytes += reserved;
+  bytesRequested_ += requirements.size;
+  bytesAllocated_ += reserved;
+  ++allocationCount_;
+
+  GpuAllocation allocation{};
+  allocation.memory = block.memory;
+  allocation.offset = offset;
+  allocation.size = reserved;
+  allocation.requestedSize = requirements.size;
+  allocation.mapped = block.mapped ? block.mapped + offset : nullptr;
+  allocation.block = blockIndex + 1;
+  return allocation;
+}
+
+void GpuAllocator::free(GpuAllocation& allocation) {
+  if (allocation.block == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  const uint32_t blockIndex = allocation.block - 1;
+  if (blockIndex >= blocks_.size() || !blocks_[blockIndex]) {
+    allocation = GpuAllocation{};
+    return;
+  }
+  Block& block = *blocks_[blockIndex];
+  --block.liveAllocations;
+  block.usedBytes -= allocation.size;
+  bytesRequested_ -= allocation.requestedSize;
+  bytesAllocated_ -= allocation.size;
+  --allocationCount_;
+
+  if (!block.dedicated) {
+    switch (block.strategy) {
+      case AllocationStrategy::Linear:
+        if (block.liveAllocations == 0) {
+          block.linearOffset = 0;
+        }
+        break;
+      case AllocationStrategy::Pool:
+        block.freeSlots.push_back(allocation.offset);
+        break;
+      case AllocationStrategy::Buddy: {
+        VkDeviceSize offset = allocation.offset;
+        uint32_t order = buddyOrder(allocation.size);
+        while (order + 1 < block.freeLists.size()) {
+          const VkDeviceSize buddy = offset ^ (kMinBuddySize << order);
+          auto found = block.freeLists[order].find(buddy);
+          if (found == block.freeLists[order].end()) {
+            break;
+          }
+          block.freeLists[order].erase(found);
+          offset = std::min(offset, buddy);
+          ++order;
+        }
+        block.freeLists[order].insert(offset);
+        break;
+      }
+    }
+  }
+
+  // Keep one empty block of each kind around so steady-state churn doesn't hit the driver.
+  if (block.liveAllocations == 0 && (block.dedicated || hasSiblingBlock(block))) {
+    releaseBlock(blockIndex);
+  }
+  allocation = GpuAllocation{};
+}
+
+void GpuAllocator::flush(const GpuAllocation& allocation) const {
+  VkMappedMemoryRange range{};
+  mappedRange(allocation, &range);
+  if (range.memory != VK_NULL_HANDLE &&
+      vkFlushMappedMemoryRanges(device_, 1, &range) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to flush mapped Vulkan memory.");
+  }
+}
+
+void GpuAllocator::invalidate(const GpuAllocation& allocation) const {
+  VkMappedMemoryRange range{};
+  mappedRange(allocation, &range);
+  if (range.memory != VK_NULL_HANDLE &&
+      vkInvalidateMappedMemoryRanges(device_, 1, &range) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to invalidate mapped Vulkan memory.");
+  }
+}
+
+GpuMemoryStats GpuAllocator::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  GpuMemoryStats stats{};
+  stats.bytesRequested = bytesRequested_;
+  stats.bytesAllocated = bytesAllocated_;
+  stats.bytesWasted = bytesAllocated_ - bytesRequested_;
+  stats.allocationCount = allocationCount_;
+  for (const auto& block : blocks_) {
+    if (!block) {
+      continue;
+    }
+    ++stats.blocksInUse;
+    stats.bytesReserved += block->size;
+    if (block->strategy == AllocationStrategy::Linear && !block->dedicated) {
+      // Freed linear space stays unusable until the whole block drains.
+      stats.bytesWasted += block->linearOffset - block->usedBytes;
+    }
+  }
+  return stats;
+}
+
+uint32_t GpuAllocator::findMemoryType(uint32_t typeFilter,
+                                      VkMemoryPropertyFlags properties) const {
+  for (uint32_t i = 0; i < memoryProperties_.memoryTypeCount; ++i) {
+    if ((typeFilter & (1u << i)) &&
+        (memoryProperties_.memoryTypes[i].propertyFlags & properties) == properties) {
+      return i;
+    }
+  }
+  throw std::runtime_error("Failed to find suitable Vulkan memory type.");
+}
+
+uint32_t GpuAllocator::createBlock(uint32_t memoryType, AllocationStrategy strategy,
+                                   VkDeviceSize size, VkDeviceSize slotSize, bool dedicated) {
+  const size_t liveBlocks = static_cast<size_t>(
+      std::count_if(blocks_.begin(), blocks_.end(), [](const auto& b) { return b != nullptr; }));
+  if (liveBlocks >= maxAllocationCount_) {
+    throw std::runtime_error("Vulkan maxMemoryAllocationCount reached.");
+  }
+
+  auto block = std::make_unique<Block>();
+  block->size = size;
+  block->memoryType = memoryType;
+  block->strategy = strategy;
+  block->dedicated = dedicated;
+  block->slotSize = slotSize;
+
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = size;
+  allocInfo.memoryTypeIndex = memoryType;
+  if (vkAllocateMemory(device_, &allocInfo, nullptr, &block->memory) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate Vulkan memory block.");
+  }
+  if (isHostVisible(memoryType)) {
+    void* mapped = nullptr;
+    if (vkMapMemory(device_, block->memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+      vkFreeMemory(device_, block->memory, nullptr);
+      throw std::runtime_error("Failed to map Vulkan memory block.");
+    }
+    block->mapped = static_cast<unsigned char*>(mapped);
+  }
+
+  if (!dedicated) {
+    if (strategy == AllocationStrategy::Pool) {
+      for (VkDeviceSize offset = size; offset >= slotSize; offset -= slotSize) {
+        block->freeSlots.push_back(offset - slotSize);
+      }
+    } else if (strategy == AllocationStrategy::Buddy) {
+      block->freeLists.resize(buddyOrder(size) + 1);
+      block->freeLists.back().insert(0);
+    }
+  }
+
+  auto slot = std::find(blocks_.begin(), blocks_.end(), nullptr);
+  if (slot == blocks_.end()) {
+    blocks_.push_back(std::move(block));
+    return static_cast<uint32_t>(blocks_.size() - 1);
+  }
+  *slot = std::move(block);
+  return static_cast<uint32_t>(slot - blocks_.begin());
+}
+
+void GpuAllocator::releaseBlock(uint32_t index) {
+  auto& block = blocks_[index];
+  if (!block) {
+    return;
+  }
+  if (block->mapped) {
+    vkUnmapMemory(device_, block->memory);
+  }
+  vkFreeMemory(device_, block->memory, nullptr);
+  block.reset();
+}
+
+bool GpuAllocator::allocateFrom(Block& block, VkDeviceSize size, VkDeviceSize alignment,
+                                VkDeviceSize* offset, VkDeviceSize* reserved) {
+  if (block.dedicated) {
+    if (block.liveAllocations > 0 || size > block.size) {
+      return false;
+    }
+    *offset = 0;
+    *reserved = block.size;
+  } else {
+    switch (block.strategy) {
+      case AllocationStrategy::Linear: {
+        const VkDeviceSize start = alignUp(block.linearOffset, alignment);
+        if (start + size > block.size) {
+          return false;
+        }
+        *offset = start;
+        *reserved = start + size - block.linearOffset;
+        block.linearOffset = start + size;
+        break;
+      }
+      case AllocationStrategy::Pool:
+        if (block.freeSlots.empty()) {
+          return false;
+        }
+        *offset = block.freeSlots.back();
+        *reserved = block.slotSize;
+        block.freeSlots.pop_back();
+        break;
+      case AllocationStrategy::Buddy: {
+        // Buddy offsets are aligned to their own size, which covers any power-of-two alignment.
+        const uint32_t order = buddyOrder(std::max(size, alignment));
+        uint32_t available = order;
+        while (available < block.freeLists.size() && block.freeLists[available].empty()) {
+          ++available;
+        }
+        if (available >= block.freeLists.size()) {
+          return false;
+        }
+        const VkDeviceSize start = *block.freeLists[available].begin();
+        block.freeLists[available].erase(block.freeLists[available].begin());
+        while (available > order) {
+          --available;
+          block.freeLists[available].insert(start + (kMinBuddySize << available));
+        }
+        *offset = start;
+        *reserved = kMinBuddySize << order;
+        break;
+      }
+    }
+  }
+  ++block.liveAllocations;
+  return true;
+}
+
+bool GpuAllocator::hasSiblingBlock(const Block& block) const {
+  return std::any_of(blocks_.begin(), blocks_.end(), [&](const auto& other) {
+    return other && other.get() != &block && !other->dedicated &&
+           other->memoryType == block.memoryType && other->strategy == block.strategy &&
+           other->slotSize == block.slotSize;
+  });
+}
+
+VkDeviceSize GpuAllocator::blockSizeFor(uint32_t memoryType) const {
+  // Small heaps (integrated GPUs, BAR windows) get proportionally smaller blocks.
+  const VkDeviceSize heapSize =
+      memoryProperties_.memoryHeaps[memoryProperties_.memoryTypes[memoryType].heapIndex].size;
+  if (heapSize <= (VkDeviceSize{1} << 30)) {
+    return std::max(kMinBlockSize, previousPowerOfTwo(heapSize / 8));
+  }
+  return kDefaultBlockSize;
+}
+
+bool GpuAllocator::isHostVisible(uint32_t memoryType) const {
+  return (memoryProperties_.memoryTypes[memoryType].propertyFlags &
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+}
+
+bool GpuAllocator::isHostCoherent(uint32_t memoryType) const {
+  return (memoryProperties_.memoryTypes[memoryType].propertyFlags &
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+void GpuAllocator::mappedRange(const GpuAllocation& allocation,
+                               VkMappedMemoryRange* range) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (allocation.block == 0 || allocation.block > blocks_.size() ||
+      !blocks_[allocation.block - 1]) {
+    return;
+  }
+  const Block& block = *blocks_[allocation.block - 1];
+  if (!block.mapped || isHostCoherent(block.memoryType)) {
+    return;
+  }
+  range->sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  range->memory = block.memory;
+  range->offset = allocation.offset;
+  // Host-visible offsets are atom-aligned, so rounding the requested size up stays inside
+  // this allocation's own bytes.
+  range->size = std::min(alignUp(allocation.requestedSize, nonCoherentAtomSize_),
+                         block.size - allocation.offset);
+}
+
+}  // namespace uvk
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace uvk {
+
+enum class AllocationStrategy {
+  // Bump allocation; a block is recycled once every allocation in it has been freed. Suits
+  // short-lived per-frame data.
+  Linear,
+  // Fixed power-of-two slots carved from shared blocks. Suits many small buffers.
+  Pool,
+  // Power-of-two buddy blocks. General purpose; large requests get a dedicated allocation.
+  Buddy,
+};
+
+struct GpuAllocation {
+  VkDeviceMemory memory{VK_NULL_HANDLE};
+  VkDeviceSize offset{};
+  // Bytes reserved for this allocation, including alignment and size-class rounding.
+  VkDeviceSize size{};
+  VkDeviceSize requestedSize{};
+  // Host pointer to the allocation for host-visible memory, nullptr otherwise.
+  void* mapped{nullptr};
+  // Index + 1 of the owning block; 0 means "no allocation".
+  uint32_t block{};
+};
+
+struct GpuMemoryStats {
+  VkDeviceSize bytesRequested{};
+  VkDeviceSize bytesAllocated{};
+  // Alignment and rounding overhead plus linear space that cannot be reused yet.
+  VkDeviceSize bytesWasted{};
+  // Device memory held by live blocks, used or not.
+  VkDeviceSize bytesReserved{};
+  size_t blocksInUse{};
+  size_t allocationCount{};
+};
+
+// Sub-allocates buffers from a small number of large VkDeviceMemory blocks per memory type.
+// Host-visible blocks are mapped once for their whole lifetime and every host-visible
+// allocation is aligned to nonCoherentAtomSize so flushes never touch a neighbour.
+class GpuAllocator {
+ public:
+  GpuAllocator();
+  ~GpuAllocator();
+
+  GpuAllocator(const GpuAllocator&) = delete;
+  GpuAllocator& operator=(const GpuAllocator&) = delete;
+
+  void initialize(VkPhysicalDevice physicalDevice, VkDevice device);
+  // Frees every block; outstanding allocations become invalid.
+  void shutdown();
+
+  GpuAllocation allocate(const VkMemoryRequirements& requirements,
+                         VkMemoryPropertyFlags properties, AllocationStrategy strategy);
+  void free(GpuAllocation& allocation);
+
+  // No-ops for host-coherent memory.
+  void flush(const GpuAllocation& allocation) const;
+  void invalidate(const GpuAllocation& allocation) const;
+
+  [[nodiscard]] GpuMemoryStats stats() const;
+  [[nodiscard]] uint32_t findMemoryType(uint32_t typeFilter,
+                                        VkMemoryPropertyFlags properties) const;
+
+ private:
+  struct Block;
+
+  uint32_t createBlock(uint32_t memoryType, AllocationStrategy strategy, VkDeviceSize size,
+                       VkDeviceSize slotSize, bool dedicated);
+  void releaseBlock(uint32_t index);
+  bool allocateFrom(Block& block, VkDeviceSize size, VkDeviceSize alignment,
+                    VkDeviceSize* offset, VkDeviceSize* reserved);
+  [[nodiscard]] bool hasSiblingBlock(const Block& block) const;
+  [[nodiscard]] VkDeviceSize blockSizeFor(uint32_t memoryType) const;
+  [[nodiscard]] bool isHostVisible(uint32_t memoryType) const;
+  [[nodiscard]] bool isHostCoherent(uint32_t memoryType) const;
+  void mappedRange(const GpuAllocation& allocation, VkMappedMemoryRange* range) const;
+
+  VkDevice device_{VK_NULL_HANDLE};
+  VkPhysicalDeviceMemoryProperties memoryProperties_{};
+  VkDeviceSize nonCoherentAtomSize_{1};
+  uint32_t maxAllocationCount_{4096};
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Block>> blocks_;
+  VkDeviceSize bytesRequested_{};
+  VkDeviceSize bytesAllocated_{};
+  size_t allocationCount_{};
+};
+
+}  // namespace uvk
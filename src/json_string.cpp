@@ -0,0 +1,40 @@
+#include "json_string.h"
+
+#include <iomanip>
+
+namespace uvk {
+
+void writeJsonString(std::ostream& output, std::string_view value) {
+  output << '"';
+  for (char c : value) {
+    switch (c) {
+      case '"':
+        output << "\\\"";
+        break;
+      case '\\':
+        output << "\\\\";
+        break;
+      case '\n':
+        output << "\\n";
+        break;
+      case '\t':
+        output << "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          const auto flags = output.flags();
+          const auto fill = output.fill();
+          output << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                 << static_cast<int>(static_cast<unsigned char>(c));
+          output.flags(flags);
+          output.fill(fill);
+        } else {
+          output << c;
+        }
+        break;
+    }
+  }
+  output << '"';
+}
+
+}  // namespace uvk
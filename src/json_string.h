@@ -0,0 +1,11 @@
+#pragma once
+
+#include <ostream>
+#include <string_view>
+
+namespace uvk {
+
+// Writes `value` as a quoted JSON string, escaping quotes, backslashes and control characters.
+void writeJsonString(std::ostream& output, std::string_view value);
+
+}  // namespace uvk
@@ -1,72 +1,440 @@
 #include "enki_ts.h"
 #include "microphone_input.h"
+#include "offline_analyzer.h"
+#include "profiler.h"
 #include "spectrum_analyzer.h"
 #include "surround_analyzer.h"
 #include "vulkan_app.h"
 #include "visualizer.h"
 #include "visualizer_presets.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace uvk {
 
+struct LaunchOptions {
+  std::string backendName{"simulator"};
+  FileCaptureOptions fileOptions;
+  PipeCaptureOptions pipeOptions;
+  bool offscreen{false};
+  OffscreenOptions offscreenOptions;
+  size_t framesInFlight{2};
+  WaterfallDrawMode drawMode{WaterfallDrawMode::Surface};
+  // 0 derives the waterfall column count from the render width.
+  size_t columns{0};
+  bool logFrequency{false};
+  WaterfallEncoding encoding;
+  WaterfallHistoryOptions history;
+  WaterfallPostProcessOptions postProcess;
+  std::string pipelineCachePath{PipelineCache::defaultPath()};
+  // Switch to the next preset every this many frames; 0 only switches on key presses.
+  size_t presetCycleFrames{0};
+  bool profile{false};
+  ProfilerOptions profiler;
+};
+
 class VisualizerApp {
  public:
-  void run(const SpectrumPreset& preset, const std::string& backendName) {
-    app_.initialize("Uvkornio Visualizer", 1280, 720);
-    const size_t fftSize = static_cast<size_t>(preset.fftSize);
-    constexpr size_t kHistoryLength = 120;
-    visualizer_.initialize(app_.context(), fftSize / 2, kHistoryLength);
-    app_.setWaterfallSource(visualizer_.waterfallBuffer(), visualizer_.waterfallBinCount(),
-                            visualizer_.waterfallHistoryLength());
-    app_.setAnalysisSource(visualizer_.analysisBuffer());
+  void run(const SpectrumPreset& preset, const LaunchOptions& options) {
+    preset_ = preset;
+    presets_ = availablePresets();
+    presetIndex_ = 0;
+    for (size_t i = 0; i < presets_.size(); ++i) {
+      if (presets_[i].name == preset.name) {
+        presetIndex_ = i;
+      }
+    }
+    app_.setFramesInFlight(options.framesInFlight);
+    app_.setPipelineCachePath(options.pipelineCachePath);
+    app_.setDrawMode(options.drawMode);
+    if (options.offscreen) {
+      app_.initializeOffscreen("Uvkornio Visualizer", options.offscreenOptions);
+    } else {
+      app_.initialize("Uvkornio Visualizer", 1280, 720);
+    }
+    if (options.postProcess.enabled) {
+      if (WaterfallPostProcessor::supported(app_.context())) {
+        visualizer_.setPostProcess(options.postProcess, &app_.pipelineCache());
+      } else {
+        std::cerr << "GPU post-processing needs a compute-capable graphics queue, using the "
+                     "CPU path.\n";
+      }
+    }
+    // More columns than pixels would only stack vertices on the same pixel.
+    BinAggregationOptions aggregation;
+    aggregation.columns = options.columns == 0 ? app_.extent().width : options.columns;
+    aggregation.logFrequency = options.logFrequency;
+    visualizer_.initialize(app_.context(), static_cast<size_t>(preset_.fftSize) / 2,
+                           options.history, aggregation, options.encoding);
+    app_.setWaterfallSource(visualizer_.waterfallBuffer(), visualizer_.waterfallLayout());
+    app_.setTransferRecorder(
+        [this](const UploadCommands& commands) { return visualizer_.recordUploads(commands); });
+    // 1-9 pick a preset by its --list-presets position, P cycles through them.
+    app_.setKeyHandler([this](int key) {
+      if (key >= GLFW_KEY_1 && key <= GLFW_KEY_9) {
+        requestPreset(static_cast<size_t>(key - GLFW_KEY_1));
+      } else if (key == GLFW_KEY_P) {
+        requestPreset((presetIndex_ + 1) % presets_.size());
+      }
+    });
 
     MicrophoneInput microphone(48000.0f, 1024);
-    microphone.selectBackend(backendName);
+    microphone.setFileOptions(options.fileOptions);
+    microphone.setPipeOptions(options.pipeOptions);
+    microphone.selectBackend(options.backendName);
     SurroundAnalyzer analyzer;
     SpectrumAnalyzer spectrumAnalyzer;
-    EnkiTaskScheduler scheduler;
-    scheduler.initialize();
-    std::cout << "Preset: " << preset.name << " | Backend: " << microphone.activeBackend()
-              << '\n';
+    scheduler_.initialize();
+    std::cout << "Preset: " << preset_.name << " | Backend: " << microphone.activeBackend()
+              << " | Waterfall: " << preset_.fftSize / 2 << " bins -> "
+              << visualizer_.waterfallBinCount() << (options.logFrequency ? " log" : "")
+              << " columns, " << waterfallFormatName(options.encoding.format) << '\n';
+    const WaterfallLayout& layout = visualizer_.waterfallLayout();
+    std::cout << "History: " << layout.rowCount() << " rows in " << layout.tierCount
+              << (layout.tierCount == 1 ? " tier" : " tiers") << " covering "
+              << visualizer_.waterfallHistorySpan() << " spectrum rows\n";
+    if (options.profile) {
+      Profiler::instance().enable(options.profiler);
+      Profiler::instance().setThreadName("main");
+      if (Profiler::instance().tracing()) {
+        Profiler::installTraceSignalHandlers();
+      }
+    }
+    size_t frame = 0;
     app_.run([&]() {
-      const auto block = microphone.captureBlock();
-      const auto analysis = analyzer.analyze(block);
-      const auto spectrum = spectrumAnalyzer.analyze(
-          block, static_cast<int>(fftSize), preset.bandEdgesHz, &scheduler);
+      if (options.presetCycleFrames > 0 && ++frame % options.presetCycleFrames == 0) {
+        requestPreset((presetIndex_ + 1) % presets_.size());
+      }
+      // Swapping at the top of the frame keeps the analysis, the waterfall and the draw on
+      // the same preset.
+      finishPresetSwitch(false);
+      SurroundBlock block;
+      {
+        UVK_PROFILE_SCOPE(Capture);
+        block = microphone.captureBlock();
+      }
+      SurroundAnalysis analysis;
+      {
+        UVK_PROFILE_SCOPE(SurroundAnalysis);
+        analysis = analyzer.analyze(block);
+      }
+      SpectrumFrame spectrum;
+      {
+        UVK_PROFILE_SCOPE(SpectrumAnalysis);
+        spectrum =
+            spectrumAnalyzer.analyze(block, preset_.fftSize, preset_.bandEdgesHz, &scheduler_);
+      }
       visualizer_.update(analysis, spectrum);
+      app_.setWaterfallHeads(visualizer_.waterfallHeads());
+      app_.setWaterfallCopy(visualizer_.waterfallCopy());
+      app_.setAnalysisMetrics(visualizer_.analysisMetrics());
     });
 
+    finishPresetSwitch(true);
+    reportHistory();
+    if (Profiler::instance().enabled()) {
+      Profiler::instance().report(std::cout);
+      Profiler::instance().disable();
+    }
     visualizer_.shutdown();
     app_.shutdown();
   }
 
  private:
+  struct PresetSwitch {
+    SpectrumPreset preset;
+    size_t index{};
+    std::unique_ptr<WaterfallRenderer> waterfall;
+    PreparedWaterfallSource source;
+  };
+
+  // Summarizes the current preset's history with one full scan, split over the workers.
+  void reportHistory() {
+    constexpr size_t kBands = 8;
+    const WaterfallStatistics statistics = visualizer_.scanWaterfall(kBands, &scheduler_);
+    if (statistics.bandMeans.empty()) {
+      return;
+    }
+    const auto loudest = std::max_element(statistics.bandMeans.begin(), statistics.bandMeans.end());
+    std::cout << "History: " << preset_.name << " peak "
+              << statistics.differential.bounds.max[1] << ", loudest band "
+              << std::distance(statistics.bandMeans.begin(), loudest) + 1 << '/'
+              << statistics.bandMeans.size() << " (mean " << *loudest << ")\n";
+  }
+
+  // Builds the waterfall and mesh for presets_[index] on a worker thread; the frame loop keeps
+  // drawing the current preset until finishPresetSwitch() finds the build done.
+  void requestPreset(size_t index) {
+    if (index >= presets_.size()) {
+      return;
+    }
+    if (presetSwitch_.valid()) {
+      // One build at a time; the latest request runs once the current one lands.
+      queuedPreset_ = index;
+      return;
+    }
+    if (index == presetIndex_) {
+      return;
+    }
+    presetSwitch_ = std::async(std::launch::async, [this, index]() {
+      if (Profiler::instance().tracing()) {
+        Profiler::instance().setThreadName("preset switch");
+      }
+      PresetSwitch result;
+      result.preset = presets_[index];
+      result.index = index;
+      result.waterfall =
+          visualizer_.createWaterfall(static_cast<size_t>(result.preset.fftSize) / 2);
+      result.source =
+          app_.prepareWaterfallSource(result.waterfall->buffer(), result.waterfall->layout());
+      return result;
+    });
+  }
+
+  void finishPresetSwitch(bool wait) {
+    if (!presetSwitch_.valid()) {
+      return;
+    }
+    if (!wait &&
+        presetSwitch_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      return;
+    }
+    PresetSwitch result;
+    try {
+      result = presetSwitch_.get();
+    } catch (const std::exception& ex) {
+      std::cerr << "Preset switch failed: " << ex.what() << '\n';
+      queuedPreset_.reset();
+      return;
+    }
+    reportHistory();
+    std::shared_ptr<WaterfallRenderer> previous =
+        visualizer_.replaceWaterfall(std::move(result.waterfall));
+    app_.switchWaterfallSource(std::move(result.source),
+                               [previous]() { previous->shutdown(); });
+    preset_ = result.preset;
+    presetIndex_ = result.index;
+    std::cout << "Preset: " << preset_.name << " | Waterfall: " << preset_.fftSize / 2
+              << " bins -> " << visualizer_.waterfallBinCount() << " columns\n";
+    if (queuedPreset_ && !wait) {
+      const size_t next = *queuedPreset_;
+      queuedPreset_.reset();
+      requestPreset(next);
+    }
+  }
+
   VulkanApp app_;
   Visualizer visualizer_;
+  EnkiTaskScheduler scheduler_;
+  SpectrumPreset preset_;
+  std::vector<SpectrumPreset> presets_;
+  size_t presetIndex_{};
+  std::future<PresetSwitch> presetSwitch_;
+  std::optional<size_t> queuedPreset_;
 };
 
+void runOffline(const SpectrumPreset& preset, FileCaptureOptions fileOptions,
+                const std::string& outputPath, const OfflineOptions& options) {
+  if (fileOptions.path.empty()) {
+    throw std::runtime_error("--offline needs an --input file.");
+  }
+  fileOptions.realtime = false;
+  fileOptions.loop = false;
+  FileCapture capture;
+  capture.open(fileOptions);
+
+  std::ofstream file;
+  if (!outputPath.empty()) {
+    file.open(outputPath);
+    if (!file) {
+      throw std::runtime_error("Failed to open offline output file: " + outputPath);
+    }
+  }
+  std::ostream& output = outputPath.empty() ? std::cout : file;
+  std::ostream& log = outputPath.empty() ? std::cerr : std::cout;
+
+  EnkiTaskScheduler scheduler;
+  scheduler.initialize();
+  const auto report = OfflineAnalyzer{}.run(capture, preset, options, scheduler, output);
+  log << "Offline: " << report.blockCount << " blocks, " << report.audioSeconds
+      << " s of audio in " << report.wallSeconds << " s (" << report.realtimeFactor()
+      << "x real time, " << scheduler.threadCount() << " threads)\n";
+  if (!report.bands.bandMeans.empty()) {
+    log << "Band means:";
+    for (const float mean : report.bands.bandMeans) {
+      log << ' ' << mean;
+    }
+    log << '\n';
+  }
+}
+
 }  // namespace uvk
 
 int main(int argc, char** argv) {
   try {
     std::string presetName = "Wideband";
-    std::string backendName = "simulator";
+    uvk::LaunchOptions launch;
+    uvk::FileCaptureOptions& fileOptions = launch.fileOptions;
     bool listPresets = false;
     bool listBackends = false;
+    bool offline = false;
+    std::string outputPath;
+    uvk::OfflineOptions offlineOptions;
     for (int i = 1; i < argc; ++i) {
       const std::string arg = argv[i];
       if (arg.rfind("--preset=", 0) == 0) {
         presetName = arg.substr(9);
       } else if (arg.rfind("--backend=", 0) == 0) {
-        backendName = arg.substr(10);
+        launch.backendName = arg.substr(10);
+      } else if (arg.rfind("--input=", 0) == 0) {
+        fileOptions.path = arg.substr(8);
+      } else if (arg.rfind("--input-format=", 0) == 0) {
+        if (!uvk::parsePcmFormat(arg.substr(15), &fileOptions.rawFormat)) {
+          std::cerr << "Unknown input format '" << arg.substr(15) << "', using f32.\n";
+        }
+      } else if (arg.rfind("--channels=", 0) == 0) {
+        fileOptions.rawChannels = std::stoi(arg.substr(11));
+      } else if (arg.rfind("--sample-rate=", 0) == 0) {
+        fileOptions.rawSampleRate = std::stof(arg.substr(14));
+      } else if (arg == "--loop") {
+        fileOptions.loop = true;
+      } else if (arg == "--no-pacing") {
+        fileOptions.realtime = false;
+      } else if (arg == "--offline") {
+        offline = true;
+      } else if (arg.rfind("--output=", 0) == 0) {
+        outputPath = arg.substr(9);
+      } else if (arg.rfind("--hop=", 0) == 0) {
+        offlineOptions.hopSize = std::stoi(arg.substr(6));
+        if (offlineOptions.hopSize <= 0) {
+          throw std::runtime_error("--hop must be a positive number of frames.");
+        }
+      } else if (arg == "--offscreen") {
+        launch.offscreen = true;
+      } else if (arg.rfind("--frames=", 0) == 0) {
+        launch.offscreenOptions.frameCount = std::stoul(arg.substr(9));
+      } else if (arg.rfind("--size=", 0) == 0) {
+        const std::string size = arg.substr(7);
+        const size_t split = size.find('x');
+        if (split == std::string::npos) {
+          throw std::runtime_error("--size expects WIDTHxHEIGHT.");
+        }
+        launch.offscreenOptions.width = static_cast<uint32_t>(std::stoul(size.substr(0, split)));
+        launch.offscreenOptions.height = static_cast<uint32_t>(std::stoul(size.substr(split + 1)));
+      } else if (arg.rfind("--readback=", 0) == 0) {
+        launch.offscreenOptions.readbackPath = arg.substr(11);
+      } else if (arg.rfind("--frames-in-flight=", 0) == 0) {
+        launch.framesInFlight = std::stoul(arg.substr(19));
+      } else if (arg.rfind("--pipeline-cache=", 0) == 0) {
+        launch.pipelineCachePath = arg.substr(17);
+      } else if (arg == "--no-pipeline-cache") {
+        launch.pipelineCachePath.clear();
+      } else if (arg.rfind("--columns=", 0) == 0) {
+        const std::string columns = arg.substr(10);
+        launch.columns = columns == "all" ? std::numeric_limits<size_t>::max()
+                                          : static_cast<size_t>(std::stoul(columns));
+      } else if (arg == "--log-frequency") {
+        launch.logFrequency = true;
+      } else if (arg.rfind("--waterfall-format=", 0) == 0) {
+        if (!uvk::parseWaterfallFormat(arg.substr(19), &launch.encoding.format)) {
+          std::cerr << "Unknown waterfall format '" << arg.substr(19) << "', using f32.\n";
+        }
+      } else if (arg.rfind("--db-range=", 0) == 0) {
+        const std::string range = arg.substr(11);
+        const size_t split = range.find(':');
+        if (split == std::string::npos) {
+          throw std::runtime_error("--db-range expects MIN:MAX.");
+        }
+        launch.encoding.minDb = std::stof(range.substr(0, split));
+        launch.encoding.maxDb = std::stof(range.substr(split + 1));
+      } else if (arg.rfind("--history-rows=", 0) == 0) {
+        launch.history.rowsPerTier = std::max<size_t>(std::stoul(arg.substr(15)), 2);
+      } else if (arg.rfind("--history-tiers=", 0) == 0) {
+        launch.history.tiers = std::stoul(arg.substr(16));
+      } else if (arg.rfind("--history-reduce=", 0) == 0) {
+        const std::string reduce = arg.substr(17);
+        if (reduce == "max") {
+          launch.history.reduction = uvk::HistoryReduction::Max;
+        } else if (reduce == "mean") {
+          launch.history.reduction = uvk::HistoryReduction::Mean;
+        } else {
+          std::cerr << "Unknown history reduction '" << reduce << "', using max.\n";
+        }
+      } else if (arg == "--gpu-postprocess" || arg.rfind("--gpu-postprocess=", 0) == 0) {
+        launch.postProcess.enabled = true;
+        const std::string scale = arg.size() > 18 ? arg.substr(18) : "db";
+        if (scale == "linear") {
+          launch.postProcess.decibels = false;
+        } else if (scale != "db") {
+          std::cerr << "Unknown post-process scale '" << scale << "', using db.\n";
+        }
+      } else if (arg.rfind("--smoothing=", 0) == 0) {
+        launch.postProcess.smoothing = std::stof(arg.substr(12));
+      } else if (arg.rfind("--peak-decay=", 0) == 0) {
+        launch.postProcess.peakDecay = std::stof(arg.substr(13));
+      } else if (arg.rfind("--draw-mode=", 0) == 0) {
+        const std::string mode = arg.substr(12);
+        if (mode == "points") {
+          launch.drawMode = uvk::WaterfallDrawMode::Points;
+        } else if (mode == "surface") {
+          launch.drawMode = uvk::WaterfallDrawMode::Surface;
+        } else {
+          std::cerr << "Unknown draw mode '" << mode << "', using surface.\n";
+        }
+      } else if (arg.rfind("--preset-cycle=", 0) == 0) {
+        launch.presetCycleFrames = std::stoul(arg.substr(15));
+      } else if (arg == "--profile" || arg.rfind("--profile=", 0) == 0) {
+#if defined(UVK_ENABLE_PROFILER)
+        launch.profile = true;
+        if (arg.size() > 10) {
+          launch.profiler.csvPath = arg.substr(10);
+        }
+#else
+        std::cerr << "Profiling was not compiled in (UVK_ENABLE_PROFILER), ignoring " << arg
+                  << ".\n";
+#endif
+      } else if (arg.rfind("--trace=", 0) == 0) {
+#if defined(UVK_ENABLE_PROFILER)
+        launch.profile = true;
+        launch.profiler.tracePath = arg.substr(8);
+#else
+        std::cerr << "Tracing was not compiled in (UVK_ENABLE_PROFILER), ignoring " << arg
+                  << ".\n";
+#endif
+      } else if (arg.rfind("--profile-window=", 0) == 0) {
+        launch.profiler.windowFrames = std::max<size_t>(std::stoul(arg.substr(17)), 1);
+      } else if (arg.rfind("--profile-interval=", 0) == 0) {
+        launch.profiler.csvIntervalFrames = std::max<size_t>(std::stoul(arg.substr(19)), 1);
       } else if (arg == "--list-presets") {
         listPresets = true;
       } else if (arg == "--list-backends") {
         listBackends = true;
       } else if (arg == "--help") {
         std::cout
-            << "Usage: uvkornio_visualizer [--preset=Name] [--backend=simulator|alsa]\n"
+            << "Usage: uvkornio_visualizer [--preset=Name] [--backend=simulator|alsa|file|pipe]\n"
+               "       [--input=path.wav|path.raw|fifo|-] [--loop] [--no-pacing]\n"
+               "       [--input-format=s16|s24|s32|f32] [--channels=N] [--sample-rate=Hz]\n"
+               "       [--frames-in-flight=1-4] [--pipeline-cache=path] [--no-pipeline-cache]\n"
+               "       [--draw-mode=surface|points] [--columns=N|all] [--log-frequency]\n"
+               "       [--waterfall-format=f32|f16|db8] [--db-range=MIN:MAX]\n"
+               "       [--history-rows=N] [--history-tiers=1-8] [--history-reduce=max|mean]\n"
+               "       [--gpu-postprocess[=db|linear]] [--smoothing=0-1] [--peak-decay=0-1]\n"
+               "       [--profile[=stages.csv]] [--profile-window=frames]\n"
+               "       [--profile-interval=frames] [--trace=trace.json]\n"
+               "       uvkornio_visualizer --offline --input=path [--output=results.csv]\n"
+               "       [--hop=frames] [--preset=Name]\n"
+               "       uvkornio_visualizer --offscreen [--frames=N] [--size=WxH]\n"
+               "       [--readback=frame.ppm] [--preset=Name] [--backend=...]\n"
+               "       [--preset-cycle=frames]\n"
                "       uvkornio_visualizer --list-presets\n"
                "       uvkornio_visualizer --list-backends\n";
         return 0;
@@ -82,16 +450,29 @@ int main(int argc, char** argv) {
     if (listBackends) {
       std::cout << "Available backends:\n"
                    " - simulator\n"
-                   " - alsa (if enabled at build time)\n";
+                   " - alsa (if enabled at build time)\n"
+                   " - file (memory-mapped WAV or raw PCM, see --input)\n"
+                   " - pipe (interleaved PCM from stdin or a FIFO)\n";
       return 0;
     }
+    uvk::PipeCaptureOptions& pipeOptions = launch.pipeOptions;
+    if (!fileOptions.path.empty()) {
+      pipeOptions.path = fileOptions.path;
+    }
+    pipeOptions.format = fileOptions.rawFormat;
+    pipeOptions.channels = fileOptions.rawChannels;
+    pipeOptions.sampleRate = fileOptions.rawSampleRate;
     bool presetFound = false;
     const auto preset = uvk::presetByName(presetName, &presetFound);
     if (!presetFound) {
       std::cerr << "Unknown preset '" << presetName << "', falling back to Wideband.\n";
     }
+    if (offline) {
+      uvk::runOffline(preset, fileOptions, outputPath, offlineOptions);
+      return 0;
+    }
     uvk::VisualizerApp app;
-    app.run(preset, backendName);
+    app.run(preset, launch);
   } catch (const std::exception& ex) {
     std::cerr << "Visualizer failed: " << ex.what() << '\n';
     return 1;
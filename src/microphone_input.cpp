@@ -49,10 +49,29 @@ SurroundBlock MicrophoneInput::captureBlock() {
     return captureFromAlsa();
   }
 #endif
+  if (activeBackend_ == "file") {
+    return fileCapture_.nextBlock(fallbackStream_.blockSize());
+  }
+  if (activeBackend_ == "pipe") {
+    return pipeCapture_.nextBlock(fallbackStream_.blockSize());
+  }
   return fallbackStream_.nextBlock();
 }
 
 void MicrophoneInput::selectBackend(const std::string& name) {
+  if (name == "file") {
+    pipeCapture_.close();
+    fileCapture_.open(fileOptions_);
+    activeBackend_ = "file";
+    return;
+  }
+  fileCapture_.close();
+  if (name == "pipe") {
+    pipeCapture_.open(pipeOptions_, fallbackStream_.blockSize());
+    activeBackend_ = "pipe";
+    return;
+  }
+  pipeCapture_.close();
   if (name == "alsa") {
 #ifdef UVK_ENABLE_ALSA
     if (initializeAlsa()) {
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "audio_stream.h"
+#include "file_capture.h"
+#include "pipe_capture.h"
 
 #include <string>
 
@@ -13,6 +15,8 @@ class MicrophoneInput {
 
   SurroundBlock captureBlock();
   void selectBackend(const std::string& name);
+  void setFileOptions(const FileCaptureOptions& options) { fileOptions_ = options; }
+  void setPipeOptions(const PipeCaptureOptions& options) { pipeOptions_ = options; }
   [[nodiscard]] const std::string& activeBackend() const noexcept { return activeBackend_; }
 
  private:
@@ -20,6 +24,10 @@ class MicrophoneInput {
   SurroundBlock captureFromAlsa();
 
   AudioStream fallbackStream_;
+  FileCapture fileCapture_;
+  FileCaptureOptions fileOptions_;
+  PipeCapture pipeCapture_;
+  PipeCaptureOptions pipeOptions_;
   std::string activeBackend_{"simulator"};
 #ifdef UVK_ENABLE_ALSA
   struct AlsaState;
@@ -0,0 +1,135 @@
+#include "offline_analyzer.h"
+
+#include "spectrum_analyzer.h"
+#include "surround_analyzer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace uvk {
+
+namespace {
+
+struct ChunkOutput {
+  std::string text;
+  // bandCount floats per block, in block order.
+  std::vector<float> bandEnergies;
+};
+
+struct PendingChunk {
+  // Declared before task so it outlives it: if an earlier chunk throws, the deque unwinds and
+  // task's destructor blocks until the chunk has finished writing here.
+  std::unique_ptr<ChunkOutput> output;
+  std::future<void> task;
+};
+
+void analyzeChunk(const FileCapture& capture, const SpectrumPreset& preset,
+                  const OfflineOptions& options, size_t firstBlock, size_t blockCount,
+                  ChunkOutput& output) {
+  const size_t bandCount = preset.bandEdgesHz.empty() ? 0 : preset.bandEdgesHz.size() - 1;
+  output.bandEnergies.reserve(blockCount * bandCount);
+  SurroundAnalyzer surroundAnalyzer;
+  SpectrumAnalyzer spectrumAnalyzer;
+  std::ostringstream stream;
+  for (size_t block = firstBlock; block < firstBlock + blockCount; ++block) {
+    const size_t frameOffset = block * static_cast<size_t>(options.hopSize);
+    const auto samples = capture.readBlock(frameOffset, static_cast<size_t>(options.blockSize));
+    const auto analysis = surroundAnalyzer.analyze(samples);
+    // Parallelism comes from running chunks side by side, so each chunk analyzes serially.
+    const auto spectrum =
+        spectrumAnalyzer.analyze(samples, preset.fftSize, preset.bandEdgesHz, nullptr);
+
+    float peakHz = 0.0f;
+    if (!spectrum.magnitudes.empty()) {
+      const auto peak = std::max_element(spectrum.magnitudes.begin(), spectrum.magnitudes.end());
+      peakHz = spectrum.frequenciesHz[static_cast<size_t>(
+          std::distance(spectrum.magnitudes.begin(), peak))];
+    }
+
+    stream << block << ',' << samples.timestampSeconds << ',' << analysis.energy << ','
+           << analysis.azimuthDegrees << ',' << analysis.elevationDegrees << ','
+           << analysis.dominantChannel << ',' << peakHz;
+    for (size_t band = 0; band < bandCount; ++band) {
+      const float energy = band < spectrum.bandEnergies.size() ? spectrum.bandEnergies[band] : 0.0f;
+      stream << ',' << energy;
+      output.bandEnergies.push_back(energy);
+    }
+    stream << '\n';
+  }
+  output.text = stream.str();
+}
+
+}  // namespace
+
+OfflineReport OfflineAnalyzer::run(const FileCapture& capture, const SpectrumPreset& preset,
+                                   const OfflineOptions& options, EnkiTaskScheduler& scheduler,
+                                   std::ostream& output) const {
+  OfflineReport report{};
+  if (options.blockSize <= 0 || options.hopSize <= 0) {
+    throw std::runtime_error("Offline block and hop sizes must be positive.");
+  }
+  if (!capture.isOpen()) {
+    return report;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  const size_t frames = capture.frameCount();
+  const size_t blockSize = static_cast<size_t>(options.blockSize);
+  const size_t hop = static_cast<size_t>(options.hopSize);
+  report.blockCount = frames > blockSize ? (frames - blockSize) / hop + 1 : 1;
+  report.audioSeconds =
+      capture.sampleRate() > 0.0f ? static_cast<double>(frames) / capture.sampleRate() : 0.0;
+
+  output << "block,time_s,energy,azimuth_deg,elevation_deg,dominant,peak_hz";
+  for (size_t band = 0; band + 1 < preset.bandEdgesHz.size(); ++band) {
+    output << ",band_" << preset.bandEdgesHz[band] << '_' << preset.bandEdgesHz[band + 1];
+  }
+  output << '\n';
+
+  // Keep at most one chunk per worker in flight and retire them oldest-first, so output stays
+  // ordered and memory stays bounded no matter how long the capture is.
+  const size_t chunkBlocks = std::max<size_t>(1, options.blocksPerChunk);
+  const size_t maxInFlight = std::max<size_t>(1, scheduler.threadCount());
+  // A few floats per block, so even hours of audio fit alongside the chunks in flight.
+  std::vector<float> bandHistory;
+  std::deque<PendingChunk> pending;
+  size_t nextBlock = 0;
+  while (nextBlock < report.blockCount || !pending.empty()) {
+    while (nextBlock < report.blockCount && pending.size() < maxInFlight) {
+      const size_t count = std::min(chunkBlocks, report.blockCount - nextBlock);
+      PendingChunk chunk;
+      chunk.output = std::make_unique<ChunkOutput>();
+      ChunkOutput* chunkOutput = chunk.output.get();
+      chunk.task =
+          scheduler.addTask([&capture, &preset, &options, nextBlock, count, chunkOutput]() {
+            analyzeChunk(capture, preset, options, nextBlock, count, *chunkOutput);
+          });
+      pending.push_back(std::move(chunk));
+      nextBlock += count;
+    }
+    PendingChunk& oldest = pending.front();
+    oldest.task.get();
+    output << oldest.output->text;
+    bandHistory.insert(bandHistory.end(), oldest.output->bandEnergies.begin(),
+                       oldest.output->bandEnergies.end());
+    pending.pop_front();
+  }
+  output.flush();
+
+  const size_t bandCount = preset.bandEdgesHz.empty() ? 0 : preset.bandEdgesHz.size() - 1;
+  report.bands = DifferentialMath::scanWaterfall(bandHistory, bandCount, report.blockCount, 0,
+                                                 bandCount, &scheduler);
+
+  report.wallSeconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return report;
+}
+
+}  // namespace uvk
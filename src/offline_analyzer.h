@@ -0,0 +1,43 @@
+#pragma once
+
+#include "differential_math.h"
+#include "enki_ts.h"
+#include "file_capture.h"
+#include "visualizer_presets.h"
+
+#include <ostream>
+
+namespace uvk {
+
+struct OfflineOptions {
+  // Both must be positive; run() throws otherwise.
+  int blockSize{1024};
+  // Frames between successive analysis blocks; smaller than blockSize for overlapping blocks.
+  int hopSize{1024};
+  size_t blocksPerChunk{256};
+};
+
+struct OfflineReport {
+  size_t blockCount{};
+  double audioSeconds{};
+  double wallSeconds{};
+  // Every block's band energies scanned as one history with a column per band: bandMeans
+  // holds each band's mean over the capture and rowMaxima each block's loudest band energy.
+  WaterfallStatistics bands;
+
+  [[nodiscard]] double realtimeFactor() const noexcept {
+    return wallSeconds > 0.0 ? audioSeconds / wallSeconds : 0.0;
+  }
+};
+
+// Runs the surround and spectrum analyzers over a whole capture without a window or Vulkan.
+// The file is split into chunks of consecutive (possibly overlapping) blocks that are analyzed
+// in parallel on the scheduler; results are written as CSV in block order.
+class OfflineAnalyzer {
+ public:
+  OfflineReport run(const FileCapture& capture, const SpectrumPreset& preset,
+                    const OfflineOptions& options, EnkiTaskScheduler& scheduler,
+                    std::ostream& output) const;
+};
+
+}  // namespace uvk
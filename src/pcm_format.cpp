@@ -0,0 +1,132 @@
+#include "pcm_format.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace uvk {
+
+namespace {
+
+template <PcmFormat Format>
+float decodeSample(const unsigned char* bytes) {
+  if constexpr (Format == PcmFormat::Int16) {
+    const auto value = static_cast<int16_t>(static_cast<uint16_t>(bytes[0]) |
+                                            (static_cast<uint16_t>(bytes[1]) << 8));
+    return static_cast<float>(value) * (1.0f / 32768.0f);
+  } else if constexpr (Format == PcmFormat::Int24) {
+    const uint32_t raw = static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+                         (static_cast<uint32_t>(bytes[2]) << 16);
+    const auto value = static_cast<int32_t>(raw << 8) >> 8;
+    return static_cast<float>(value) * (1.0f / 8388608.0f);
+  } else if constexpr (Format == PcmFormat::Int32) {
+    const uint32_t raw = static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+                         (static_cast<uint32_t>(bytes[2]) << 16) |
+                         (static_cast<uint32_t>(bytes[3]) << 24);
+    return static_cast<float>(static_cast<int32_t>(raw)) * (1.0f / 2147483648.0f);
+  } else {
+    const uint32_t raw = static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+                         (static_cast<uint32_t>(bytes[2]) << 16) |
+                         (static_cast<uint32_t>(bytes[3]) << 24);
+    float value = 0.0f;
+    std::memcpy(&value, &raw, sizeof(value));
+    return value;
+  }
+}
+
+template <PcmFormat Format>
+void decodeFrames(const unsigned char* source, size_t frameCount, int channels,
+                  std::array<float, 8>* destination) {
+  constexpr size_t kBytes = Format == PcmFormat::Int16   ? 2
+                            : Format == PcmFormat::Int24 ? 3
+                                                         : 4;
+  const size_t frameBytes = kBytes * static_cast<size_t>(channels);
+  if (channels == 1) {
+    for (size_t frame = 0; frame < frameCount; ++frame) {
+      destination[frame].fill(decodeSample<Format>(source + frame * frameBytes));
+    }
+    return;
+  }
+  const size_t used = static_cast<size_t>(std::min(channels, 8));
+  for (size_t frame = 0; frame < frameCount; ++frame) {
+    const unsigned char* bytes = source + frame * frameBytes;
+    std::array<float, 8>& sample = destination[frame];
+    for (size_t channel = 0; channel < used; ++channel) {
+      sample[channel] = decodeSample<Format>(bytes + channel * kBytes);
+    }
+    for (size_t channel = used; channel < sample.size(); ++channel) {
+      sample[channel] = 0.0f;
+    }
+  }
+}
+
+}  // namespace
+
+size_t pcmBytesPerSample(PcmFormat format) noexcept {
+  switch (format) {
+    case PcmFormat::Int16:
+      return 2;
+    case PcmFormat::Int24:
+      return 3;
+    case PcmFormat::Int32:
+    case PcmFormat::Float32:
+      return 4;
+  }
+  return 4;
+}
+
+const char* pcmFormatName(PcmFormat format) noexcept {
+  switch (format) {
+    case PcmFormat::Int16:
+      return "s16";
+    case PcmFormat::Int24:
+      return "s24";
+    case PcmFormat::Int32:
+      return "s32";
+    case PcmFormat::Float32:
+      return "f32";
+  }
+  return "f32";
+}
+
+bool parsePcmFormat(const std::string& name, PcmFormat* format) {
+  PcmFormat parsed{};
+  if (name == "s16") {
+    parsed = PcmFormat::Int16;
+  } else if (name == "s24") {
+    parsed = PcmFormat::Int24;
+  } else if (name == "s32") {
+    parsed = PcmFormat::Int32;
+  } else if (name == "f32") {
+    parsed = PcmFormat::Float32;
+  } else {
+    return false;
+  }
+  if (format) {
+    *format = parsed;
+  }
+  return true;
+}
+
+void decodePcmFrames(const unsigned char* source, size_t frameCount, int channels,
+                     PcmFormat format, std::array<float, 8>* destination) {
+  if (!source || !destination || channels <= 0) {
+    return;
+  }
+  switch (format) {
+    case PcmFormat::Int16:
+      decodeFrames<PcmFormat::Int16>(source, frameCount, channels, destination);
+      break;
+    case PcmFormat::Int24:
+      decodeFrames<PcmFormat::Int24>(source, frameCount, channels, destination);
+      break;
+    case PcmFormat::Int32:
+      decodeFrames<PcmFormat::Int32>(source, frameCount, channels, destination);
+      break;
+    case PcmFormat::Float32:
+      decodeFrames<PcmFormat::Float32>(source, frameCount, channels, destination);
+      break;
+  }
+}
+
+}  // namespace uvk
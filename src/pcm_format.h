@@ -0,0 +1,26 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <string>
+
+namespace uvk {
+
+enum class PcmFormat {
+  Int16,
+  Int24,
+  Int32,
+  Float32,
+};
+
+[[nodiscard]] size_t pcmBytesPerSample(PcmFormat format) noexcept;
+[[nodiscard]] const char* pcmFormatName(PcmFormat format) noexcept;
+bool parsePcmFormat(const std::string& name, PcmFormat* format);
+
+// Decodes interleaved little-endian PCM frames into 8-channel surround samples.
+// Mono input is broadcast to every channel (matching the ALSA path); otherwise the
+// first min(channels, 8) channels are copied and the remainder is zeroed.
+void decodePcmFrames(const unsigned char* source, size_t frameCount, int channels,
+                     PcmFormat format, std::array<float, 8>* destination);
+
+}  // namespace uvk
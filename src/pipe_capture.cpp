@@ -0,0 +1,177 @@
+#include "pipe_capture.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace uvk {
+
+namespace {
+
+// Enough ring for a quarter second of audio (or 16 blocks), so a slow frame on the render
+// side never lets the writer's pipe buffer fill up and stall the recorder.
+constexpr size_t kMinRingBlocks = 16;
+constexpr int kPipeBufferBytes = 1 << 20;
+constexpr int kPollTimeoutMs = 100;
+
+}  // namespace
+
+PipeCapture::~PipeCapture() {
+  close();
+}
+
+void PipeCapture::open(const PipeCaptureOptions& options, int blockSize) {
+  close();
+  if (options.channels <= 0 || options.sampleRate <= 0.0f || blockSize <= 0) {
+    throw std::runtime_error("Pipe capture needs a channel count, sample rate and block size.");
+  }
+#ifdef _WIN32
+  (void)options;
+  throw std::runtime_error("Pipe capture is not supported on this platform.");
+#else
+  format_ = options.format;
+  channels_ = options.channels;
+  sampleRate_ = options.sampleRate;
+  frameBytes_ = pcmBytesPerSample(format_) * static_cast<size_t>(channels_);
+
+  const size_t ringFrames = std::max(static_cast<size_t>(blockSize) * kMinRingBlocks,
+                                     static_cast<size_t>(sampleRate_ / 4.0f));
+  ring_.assign(ringFrames * frameBytes_, 0);
+  readOffset_ = 0;
+  filled_ = 0;
+  framesDelivered_ = 0;
+  endOfStream_ = false;
+
+  if (options.path.empty() || options.path == "-") {
+    fd_ = STDIN_FILENO;
+    ownsDescriptor_ = false;
+  } else {
+    // Blocking open waits for a writer on a FIFO so the first read does not report EOF.
+    fd_ = ::open(options.path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+      throw std::runtime_error("Failed to open capture pipe: " + options.path);
+    }
+    ownsDescriptor_ = true;
+  }
+
+  originalFlags_ = fcntl(fd_, F_GETFL);
+  if (originalFlags_ < 0 || fcntl(fd_, F_SETFL, originalFlags_ | O_NONBLOCK) < 0) {
+    close();
+    throw std::runtime_error("Failed to make capture pipe non-blocking.");
+  }
+#ifdef F_SETPIPE_SZ
+  // Best effort: a larger kernel pipe buffer absorbs scheduling jitter on the writer side.
+  fcntl(fd_, F_SETPIPE_SZ, kPipeBufferBytes);
+#else
+  (void)kPipeBufferBytes;
+#endif
+#endif
+}
+
+void PipeCapture::close() {
+#ifndef _WIN32
+  if (fd_ >= 0) {
+    if (ownsDescriptor_) {
+      ::close(fd_);
+    } else if (originalFlags_ >= 0) {
+      fcntl(fd_, F_SETFL, originalFlags_);
+    }
+  }
+#endif
+  fd_ = -1;
+  originalFlags_ = -1;
+  ownsDescriptor_ = false;
+  endOfStream_ = false;
+  ring_.clear();
+  readOffset_ = 0;
+  filled_ = 0;
+}
+
+bool PipeCapture::fill() {
+#ifdef _WIN32
+  return false;
+#else
+  const size_t capacity = ring_.size();
+  if (endOfStream_ || filled_ == capacity) {
+    return false;
+  }
+  // Read into both halves of the free region in one syscall so wrap-around costs nothing.
+  const size_t writeOffset = (readOffset_ + filled_) % capacity;
+  const size_t freeBytes = capacity - filled_;
+  const size_t firstPart = std::min(freeBytes, capacity - writeOffset);
+  iovec parts[2]{};
+  parts[0].iov_base = ring_.data() + writeOffset;
+  parts[0].iov_len = firstPart;
+  parts[1].iov_base = ring_.data();
+  parts[1].iov_len = freeBytes - firstPart;
+  const int partCount = parts[1].iov_len > 0 ? 2 : 1;
+
+  const ssize_t bytesRead = readv(fd_, parts, partCount);
+  if (bytesRead > 0) {
+    filled_ += static_cast<size_t>(bytesRead);
+    return true;
+  }
+  if (bytesRead == 0) {
+    endOfStream_ = true;
+    return false;
+  }
+  if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+    return false;
+  }
+  throw std::runtime_error("Failed to read from capture pipe.");
+#endif
+}
+
+void PipeCapture::waitReadable() const {
+#ifndef _WIN32
+  pollfd descriptor{};
+  descriptor.fd = fd_;
+  descriptor.events = POLLIN;
+  poll(&descriptor, 1, kPollTimeoutMs);
+#endif
+}
+
+SurroundBlock PipeCapture::nextBlock(int blockSize) {
+  SurroundBlock block;
+  block.sampleRate = sampleRate_;
+  block.timestampSeconds =
+      sampleRate_ > 0.0f ? static_cast<double>(framesDelivered_) / sampleRate_ : 0.0;
+  if (fd_ < 0 || blockSize <= 0 || ring_.empty()) {
+    return block;
+  }
+
+  const size_t capacity = ring_.size();
+  const size_t needed = std::min(static_cast<size_t>(blockSize) * frameBytes_, capacity);
+  while (filled_ < needed && !endOfStream_) {
+    if (!fill() && !endOfStream_) {
+      waitReadable();
+    }
+  }
+  // Opportunistically drain whatever else the writer has queued while we are here.
+  fill();
+
+  const size_t frames = std::min(filled_, needed) / frameBytes_;
+  block.samples.resize(frames);
+  const size_t firstFrames = std::min(frames, (capacity - readOffset_) / frameBytes_);
+  decodePcmFrames(ring_.data() + readOffset_, firstFrames, channels_, format_,
+                  block.samples.data());
+  if (frames > firstFrames) {
+    decodePcmFrames(ring_.data(), frames - firstFrames, channels_, format_,
+                    block.samples.data() + firstFrames);
+  }
+
+  const size_t consumed = frames * frameBytes_;
+  readOffset_ = (readOffset_ + consumed) % capacity;
+  filled_ -= consumed;
+  framesDelivered_ += frames;
+  return block;
+}
+
+}  // namespace uvk
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "audio_stream.h"
+#include "pcm_format.h"
+
+#include <string>
+#include <vector>
+
+namespace uvk {
+
+struct PipeCaptureOptions {
+  // "-" or empty reads stdin; anything else is opened as a named FIFO (or regular file).
+  std::string path{"-"};
+  PcmFormat format{PcmFormat::Float32};
+  int channels{8};
+  float sampleRate{48000.0f};
+};
+
+// Streams interleaved PCM from stdin or a FIFO. Bytes are pulled with large non-blocking
+// reads into a fixed ring sized to a multiple of the frame size, and blocks are decoded
+// directly out of the ring so no per-block staging vectors are allocated.
+class PipeCapture {
+ public:
+  PipeCapture() = default;
+  ~PipeCapture();
+
+  PipeCapture(const PipeCapture&) = delete;
+  PipeCapture& operator=(const PipeCapture&) = delete;
+
+  void open(const PipeCaptureOptions& options, int blockSize);
+  void close();
+
+  SurroundBlock nextBlock(int blockSize);
+
+  [[nodiscard]] bool isOpen() const noexcept { return fd_ >= 0; }
+  [[nodiscard]] bool exhausted() const noexcept { return endOfStream_ && filled_ < frameBytes_; }
+  [[nodiscard]] float sampleRate() const noexcept { return sampleRate_; }
+
+ private:
+  bool fill();
+  void waitReadable() const;
+
+  std::vector<unsigned char> ring_;
+  size_t readOffset_{};
+  size_t filled_{};
+  size_t frameBytes_{};
+  size_t framesDelivered_{};
+  PcmFormat format_{PcmFormat::Float32};
+  int channels_{};
+  float sampleRate_{};
+  int fd_{-1};
+  int originalFlags_{-1};
+  bool ownsDescriptor_{false};
+  bool endOfStream_{false};
+};
+
+}  // namespace uvk
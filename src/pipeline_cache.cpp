@@ -0,0 +1,188 @@
+#include "pipeline_cache.h"
+
+#include "vulkan_context.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+namespace uvk {
+
+namespace {
+
+std::string readBinaryFile(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return {};
+  }
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// The build writes SPIR-V into its own tree (UVK_SHADER_DIR); shaders/ in the working
+// directory is only used when that has no copy, e.g. for shaders compiled by hand.
+std::string shaderPath(const std::string& name) {
+#ifdef UVK_SHADER_DIR
+  const std::filesystem::path built = std::filesystem::path(UVK_SHADER_DIR) / name;
+  std::error_code error;
+  if (std::filesystem::exists(built, error)) {
+    return built.string();
+  }
+#endif
+  return (std::filesystem::path("shaders") / name).string();
+}
+
+}  // namespace
+
+PipelineCache::~PipelineCache() {
+  shutdown();
+}
+
+void PipelineCache::initialize(const VulkanContext& context, const std::string& path) {
+  device_ = context.device();
+  properties_ = context.properties();
+  path_ = path;
+  loadedBytes_ = 0;
+
+  std::string data;
+  if (!path_.empty()) {
+    data = readBinaryFile(path_);
+    if (!data.empty() && !headerMatches(data)) {
+      std::cout << "Pipeline cache: discarding " << path_
+                << " (written by a different GPU or driver)\n";
+      data.clear();
+    }
+  }
+
+  VkPipelineCacheCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  createInfo.initialDataSize = data.size();
+  createInfo.pInitialData = data.empty() ? nullptr : data.data();
+  if (vkCreatePipelineCache(device_, &createInfo, nullptr, &cache_) != VK_SUCCESS) {
+    // The header checked out but the driver still rejected the payload; start cold.
+    createInfo.initialDataSize = 0;
+    createInfo.pInitialData = nullptr;
+    data.clear();
+    if (vkCreatePipelineCache(device_, &createInfo, nullptr, &cache_) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create pipeline cache.");
+    }
+  }
+  loadedBytes_ = data.size();
+}
+
+void PipelineCache::shutdown() {
+  if (device_ == VK_NULL_HANDLE) {
+    return;
+  }
+  if (cache_ != VK_NULL_HANDLE) {
+    try {
+      save();
+    } catch (const std::exception& ex) {
+      std::cerr << "Pipeline cache: " << ex.what() << '\n';
+    }
+    vkDestroyPipelineCache(device_, cache_, nullptr);
+    cache_ = VK_NULL_HANDLE;
+  }
+  std::lock_guard<std::mutex> lock(shaderMutex_);
+  for (const auto& [path, module] : shaderModules_) {
+    vkDestroyShaderModule(device_, module, nullptr);
+  }
+  shaderModules_.clear();
+  device_ = VK_NULL_HANDLE;
+}
+
+void PipelineCache::save() const {
+  if (path_.empty() || cache_ == VK_NULL_HANDLE) {
+    return;
+  }
+  size_t size = 0;
+  if (vkGetPipelineCacheData(device_, cache_, &size, nullptr) != VK_SUCCESS || size == 0) {
+    return;
+  }
+  std::vector<char> data(size);
+  if (vkGetPipelineCacheData(device_, cache_, &size, data.data()) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to read pipeline cache data.");
+  }
+
+  // Write next to the target and rename, so a crash mid-write never leaves a truncated cache.
+  const std::filesystem::path target(path_);
+  std::error_code error;
+  if (target.has_parent_path()) {
+    std::filesystem::create_directories(target.parent_path(), error);
+  }
+  const std::filesystem::path temporary = target.string() + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      throw std::runtime_error("Failed to write pipeline cache: " + temporary.string());
+    }
+    file.write(data.data(), static_cast<std::streamsize>(size));
+  }
+  std::filesystem::rename(temporary, target, error);
+  if (error) {
+    std::filesystem::remove(temporary, error);
+    throw std::runtime_error("Failed to replace pipeline cache: " + path_);
+  }
+}
+
+VkShaderModule PipelineCache::shaderModule(const std::string& name) {
+  std::lock_guard<std::mutex> lock(shaderMutex_);
+  const auto found = shaderModules_.find(name);
+  if (found != shaderModules_.end()) {
+    return found->second;
+  }
+
+  const std::string spirvPath = shaderPath(name);
+  const std::string code = readBinaryFile(spirvPath);
+  if (code.empty()) {
+    throw std::runtime_error("Failed to open shader file: " + spirvPath);
+  }
+  if (code.size() % sizeof(uint32_t) != 0) {
+    throw std::runtime_error("Shader file is not valid SPIR-V: " + spirvPath);
+  }
+  std::vector<uint32_t> words(code.size() / sizeof(uint32_t));
+  std::memcpy(words.data(), code.data(), code.size());
+
+  VkShaderModuleCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  createInfo.codeSize = code.size();
+  createInfo.pCode = words.data();
+
+  VkShaderModule module = VK_NULL_HANDLE;
+  if (vkCreateShaderModule(device_, &createInfo, nullptr, &module) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create shader module.");
+  }
+  shaderModules_.emplace(name, module);
+  return module;
+}
+
+std::string PipelineCache::defaultPath() {
+  std::filesystem::path base;
+  if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+    base = xdg;
+  } else if (const char* home = std::getenv("HOME"); home && *home) {
+    base = std::filesystem::path(home) / ".cache";
+  } else {
+    return "pipeline_cache.bin";
+  }
+  return (base / "uvkornio" / "pipeline_cache.bin").string();
+}
+
+bool PipelineCache::headerMatches(const std::string& data) const {
+  VkPipelineCacheHeaderVersionOne header{};
+  if (data.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  return header.headerSize >= sizeof(header) && header.headerSize <= data.size() &&
+         header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header.vendorID == properties_.vendorID && header.deviceID == properties_.deviceID &&
+         std::memcmp(header.pipelineCacheUUID, properties_.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+}  // namespace uvk
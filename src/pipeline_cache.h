@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace uvk {
+
+class VulkanContext;
+
+// Owns the VkPipelineCache and the shader modules pipelines are built from. The cache is
+// loaded from disk on initialize() and written back on shutdown(); a file produced by another
+// GPU or driver version is discarded instead of being handed to the driver. Shader modules are
+// read once and kept, so rebuilding a pipeline after a resize never touches the filesystem.
+// Both the cache and shaderModule() are safe to use from a background compile thread.
+class PipelineCache {
+ public:
+  PipelineCache() = default;
+  ~PipelineCache();
+
+  PipelineCache(const PipelineCache&) = delete;
+  PipelineCache& operator=(const PipelineCache&) = delete;
+
+  // An empty path keeps the cache in memory only.
+  void initialize(const VulkanContext& context, const std::string& path);
+  // Saves the cache (if a path was given) and destroys it and every shader module.
+  void shutdown();
+  void save() const;
+
+  // `name` is a SPIR-V file such as "waterfall.vert.spv", looked up in the build's shader
+  // directory and then in shaders/ under the working directory.
+  VkShaderModule shaderModule(const std::string& name);
+
+  [[nodiscard]] VkPipelineCache handle() const noexcept { return cache_; }
+  // Bytes of valid cache data found on disk at initialize(), 0 on a cold start.
+  [[nodiscard]] size_t loadedBytes() const noexcept { return loadedBytes_; }
+  [[nodiscard]] const std::string& path() const noexcept { return path_; }
+
+  // $XDG_CACHE_HOME/uvkornio/pipeline_cache.bin, falling back to ~/.cache and then to the
+  // working directory.
+  static std::string defaultPath();
+
+ private:
+  bool headerMatches(const std::string& data) const;
+
+  VkDevice device_{VK_NULL_HANDLE};
+  VkPhysicalDeviceProperties properties_{};
+  VkPipelineCache cache_{VK_NULL_HANDLE};
+  std::string path_;
+  size_t loadedBytes_{0};
+  std::mutex shaderMutex_;
+  std::unordered_map<std::string, VkShaderModule> shaderModules_;
+};
+
+}  // namespace uvk
@@ -0,0 +1,397 @@
+#include "profiler.h"
+
+#include "json_string.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace uvk {
+
+namespace {
+
+constexpr std::array<const char*, kProfileStageCount> kStageNames{
+    "capture", "surround", "spectrum", "waterfall", "upload", "record", "submit",
+    "present", "wait", "gpu-upload", "gpu-transfer", "gpu-draw", "task", "frame",
+};
+
+constexpr std::array<const char*, kProfileCounterCount> kCounterNames{
+    "tasks-pending", "frames-in-flight", "retired-resources", "gpu-allocations",
+    "gpu-allocated-kib",
+};
+
+// GPU intervals get their own trace tracks, away from the thread that read them back. They
+// start at the frame's submission, so their placement (not their length) is approximate.
+constexpr uint32_t kGpuGraphicsTrack = 1000000;
+constexpr uint32_t kGpuTransferTrack = 1000001;
+
+std::atomic<bool> traceFlushRequested{false};
+std::atomic<int> terminatingSignal{0};
+
+void onTraceSignal(int signal) {
+  if (signal == SIGINT || signal == SIGTERM) {
+    // A second signal terminates right away, in case the frame loop is stuck.
+    terminatingSignal.store(signal);
+    std::signal(signal, SIG_DFL);
+  }
+  traceFlushRequested.store(true);
+}
+
+bool isGpuStage(uint8_t stage) {
+  return stage == static_cast<uint8_t>(ProfileStage::GpuUpload) ||
+         stage == static_cast<uint8_t>(ProfileStage::GpuTransfer) ||
+         stage == static_cast<uint8_t>(ProfileStage::GpuDraw);
+}
+
+void writeThreadName(std::ostream& output, uint32_t threadId, const std::string& name) {
+  output << ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << threadId
+         << ",\"args\":{\"name\":";
+  writeJsonString(output, name);
+  output << "}}";
+}
+
+// Percentile of sorted nanosecond totals, in milliseconds.
+double percentileMs(const std::vector<uint64_t>& sorted, double fraction) {
+  return static_cast<double>(nearestRankPercentile(sorted, fraction)) / 1e6;
+}
+
+}  // namespace
+
+thread_local Profiler::RingLease Profiler::lease_;
+
+const char* profileStageName(ProfileStage stage) noexcept {
+  const size_t index = static_cast<size_t>(stage);
+  return index < kStageNames.size() ? kStageNames[index] : "unknown";
+}
+
+const char* profileCounterName(ProfileCounter counter) noexcept {
+  const size_t index = static_cast<size_t>(counter);
+  return index < kCounterNames.size() ? kCounterNames[index] : "unknown";
+}
+
+Profiler::RingLease::~RingLease() {
+  if (ring) {
+    ring->owned.store(false, std::memory_order_release);
+  }
+}
+
+Profiler& Profiler::instance() {
+  static Profiler profiler;
+  return profiler;
+}
+
+uint32_t Profiler::threadId() noexcept {
+  static std::atomic<uint32_t> nextThreadId{1};
+  thread_local const uint32_t id = nextThreadId.fetch_add(1, std::memory_order_relaxed);
+  return id;
+}
+
+uint64_t Profiler::now() noexcept {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+void Profiler::enable(const ProfilerOptions& options) {
+  options_ = options;
+  options_.windowFrames = std::max<size_t>(options_.windowFrames, 1);
+  options_.csvIntervalFrames = std::max<size_t>(options_.csvIntervalFrames, 1);
+  for (auto& window : window_) {
+    window.clear();
+    window.reserve(options_.windowFrames);
+  }
+  windowNext_.fill(0);
+  frameTotals_.fill(0);
+  frameSeen_.fill(false);
+  frameCount_ = 0;
+  lastFrameNs_ = 0;
+  trace_.clear();
+  traceDropped_ = 0;
+  traceStartNs_ = now();
+
+  if (csv_.is_open()) {
+    csv_.close();
+  }
+  if (!options_.csvPath.empty()) {
+    csv_.open(options_.csvPath, std::ios::trunc);
+    if (!csv_) {
+      throw std::runtime_error("Failed to open profile output file: " + options_.csvPath);
+    }
+    csv_ << "frame,stage,frames,p50_ms,p95_ms,p99_ms,max_ms\n";
+  }
+  tracing_.store(!options_.tracePath.empty(), std::memory_order_relaxed);
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::disable() {
+  if (tracing()) {
+    writeTrace();
+    tracing_.store(false, std::memory_order_relaxed);
+  }
+  enabled_.store(false, std::memory_order_relaxed);
+  if (csv_.is_open()) {
+    csv_.close();
+  }
+}
+
+Profiler::ThreadRing* Profiler::threadRing() {
+  if (lease_.ring) {
+    return lease_.ring;
+  }
+  std::lock_guard<std::mutex> lock(ringsMutex_);
+  for (auto& ring : rings_) {
+    bool expected = false;
+    if (ring->owned.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+      lease_.ring = ring.get();
+      return lease_.ring;
+    }
+  }
+  rings_.push_back(std::make_unique<ThreadRing>());
+  rings_.back()->owned.store(true, std::memory_order_relaxed);
+  lease_.ring = rings_.back().get();
+  return lease_.ring;
+}
+
+void Profiler::record(ProfileStage stage, uint64_t startNs, uint64_t durationNs) noexcept {
+  push(Sample{startNs, durationNs, threadId(), static_cast<uint8_t>(stage), false});
+}
+
+void Profiler::recordCounter(ProfileCounter counter, int64_t value) noexcept {
+  if (tracing()) {
+    push(Sample{now(), static_cast<uint64_t>(value), threadId(), static_cast<uint8_t>(counter),
+                true});
+  }
+}
+
+void Profiler::setThreadName(const std::string& name) {
+  const uint32_t id = threadId();
+  std::lock_guard<std::mutex> lock(ringsMutex_);
+  for (auto& entry : threadNames_) {
+    if (entry.first == id) {
+      entry.second = name;
+      return;
+    }
+  }
+  threadNames_.emplace_back(id, name);
+}
+
+void Profiler::push(const Sample& sample) noexcept {
+  ThreadRing* ring = nullptr;
+  try {
+    ring = threadRing();
+  } catch (...) {
+    return;
+  }
+  const uint32_t head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) >= ThreadRing::kCapacity) {
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  ring->samples[head % ThreadRing::kCapacity] = sample;
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::drain() {
+  std::lock_guard<std::mutex> lock(ringsMutex_);
+  for (auto& ring : rings_) {
+    uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+    const uint32_t head = ring->head.load(std::memory_order_acquire);
+    for (; tail != head; ++tail) {
+      const Sample& sample = ring->samples[tail % ThreadRing::kCapacity];
+      if (!sample.counter) {
+        frameTotals_[sample.id] += sample.value;
+        frameSeen_[sample.id] = true;
+      }
+      if (tracing()) {
+        if (trace_.size() < options_.traceMaxEvents) {
+          trace_.push_back(sample);
+        } else {
+          ++traceDropped_;
+        }
+      }
+    }
+    ring->tail.store(tail, std::memory_order_release);
+  }
+}
+
+void Profiler::endFrame() {
+  if (!enabled()) {
+    return;
+  }
+  const uint64_t frameEnd = now();
+  if (lastFrameNs_ != 0) {
+    record(ProfileStage::Frame, lastFrameNs_, frameEnd - lastFrameNs_);
+  }
+  lastFrameNs_ = frameEnd;
+  drain();
+
+  for (size_t stage = 0; stage < kProfileStageCount; ++stage) {
+    if (!frameSeen_[stage]) {
+      continue;
+    }
+    auto& window = window_[stage];
+    if (window.size() < options_.windowFrames) {
+      window.push_back(frameTotals_[stage]);
+    } else {
+      window[windowNext_[stage]] = frameTotals_[stage];
+    }
+    windowNext_[stage] = (windowNext_[stage] + 1) % options_.windowFrames;
+    frameTotals_[stage] = 0;
+    frameSeen_[stage] = false;
+  }
+
+  ++frameCount_;
+  if (csv_.is_open() && frameCount_ % options_.csvIntervalFrames == 0) {
+    writeCsv();
+  }
+  if (traceFlushRequested.exchange(false)) {
+    writeTrace();
+    if (const int signal = terminatingSignal.load(); signal != 0) {
+      // The handler already restored the default action.
+      std::raise(signal);
+    }
+  }
+}
+
+void Profiler::writeTrace() {
+  if (!tracing()) {
+    return;
+  }
+  drain();
+  std::ofstream file(options_.tracePath, std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("Failed to open trace output file: " + options_.tracePath);
+  }
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  file << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"tid\":0,"
+          "\"args\":{\"name\":\"uvkornio_visualizer\"}}";
+  {
+    std::lock_guard<std::mutex> lock(ringsMutex_);
+    for (const auto& [id, name] : threadNames_) {
+      writeThreadName(file, id, name);
+    }
+  }
+  writeThreadName(file, kGpuGraphicsTrack, "gpu graphics queue");
+  writeThreadName(file, kGpuTransferTrack, "gpu transfer queue");
+
+  // Microseconds since enable(), which is what the trace viewers expect in "ts" and "dur".
+  file << std::fixed << std::setprecision(3);
+  const auto micros = [this](uint64_t ns) {
+    return static_cast<double>(static_cast<int64_t>(ns - traceStartNs_)) / 1000.0;
+  };
+  for (const Sample& sample : trace_) {
+    if (sample.counter) {
+      file << ",\n{\"ph\":\"C\",\"name\":\"" << kCounterNames[sample.id]
+           << "\",\"pid\":1,\"tid\":" << sample.threadId << ",\"ts\":" << micros(sample.startNs)
+           << ",\"args\":{\"value\":" << static_cast<int64_t>(sample.value) << "}}";
+    } else {
+      const bool gpu = isGpuStage(sample.id);
+      uint32_t track = sample.threadId;
+      if (sample.id == static_cast<uint8_t>(ProfileStage::GpuTransfer)) {
+        track = kGpuTransferTrack;
+      } else if (gpu) {
+        track = kGpuGraphicsTrack;
+      }
+      file << ",\n{\"ph\":\"X\",\"name\":\"" << kStageNames[sample.id] << "\",\"cat\":\""
+           << (gpu ? "gpu" : "cpu") << "\",\"pid\":1,\"tid\":" << track
+           << ",\"ts\":" << micros(sample.startNs)
+           << ",\"dur\":" << static_cast<double>(sample.value) / 1000.0 << '}';
+    }
+  }
+  file << "\n]}\n";
+  std::cout << "Trace: " << trace_.size() << " events written to " << options_.tracePath;
+  if (traceDropped_ > 0) {
+    std::cout << " (" << traceDropped_ << " dropped past the event limit)";
+  }
+  std::cout << '\n';
+}
+
+void Profiler::installTraceSignalHandlers() {
+  std::signal(SIGINT, onTraceSignal);
+  std::signal(SIGTERM, onTraceSignal);
+#if defined(SIGUSR1)
+  std::signal(SIGUSR1, onTraceSignal);
+#endif
+}
+
+ProfileStats Profiler::stats(ProfileStage stage) const {
+  const auto& window = window_[static_cast<size_t>(stage)];
+  ProfileStats stats{};
+  if (window.empty()) {
+    return stats;
+  }
+  std::vector<uint64_t> sorted = window;
+  std::sort(sorted.begin(), sorted.end());
+  stats.frames = sorted.size();
+  stats.p50Ms = percentileMs(sorted, 0.50);
+  stats.p95Ms = percentileMs(sorted, 0.95);
+  stats.p99Ms = percentileMs(sorted, 0.99);
+  stats.maxMs = static_cast<double>(sorted.back()) / 1e6;
+  return stats;
+}
+
+std::string Profiler::overlayText() const {
+  std::ostringstream text;
+  text << std::fixed << std::setprecision(2) << "p95 ms";
+  for (size_t stage = 0; stage < kProfileStageCount; ++stage) {
+    const ProfileStats stageStats = stats(static_cast<ProfileStage>(stage));
+    if (stageStats.frames > 0) {
+      text << "  " << kStageNames[stage] << ' ' << stageStats.p95Ms;
+    }
+  }
+  return text.str();
+}
+
+void Profiler::report(std::ostream& output) const {
+  const auto flags = output.flags();
+  const auto precision = output.precision();
+  output << "Frame profile over the last " << options_.windowFrames << " frames (ms):\n";
+  output << std::left << std::setw(14) << "stage" << std::right << std::setw(8) << "frames"
+         << std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99"
+         << std::setw(10) << "max" << '\n';
+  output << std::fixed << std::setprecision(3);
+  for (size_t stage = 0; stage < kProfileStageCount; ++stage) {
+    const ProfileStats stageStats = stats(static_cast<ProfileStage>(stage));
+    if (stageStats.frames == 0) {
+      continue;
+    }
+    output << std::left << std::setw(14) << kStageNames[stage] << std::right << std::setw(8)
+           << stageStats.frames << std::setw(10) << stageStats.p50Ms << std::setw(10)
+           << stageStats.p95Ms << std::setw(10) << stageStats.p99Ms << std::setw(10)
+           << stageStats.maxMs << '\n';
+  }
+  if (const uint64_t dropped = droppedSamples(); dropped > 0) {
+    output << dropped << " samples dropped on full rings\n";
+  }
+  output.flags(flags);
+  output.precision(precision);
+}
+
+uint64_t Profiler::droppedSamples() const {
+  std::lock_guard<std::mutex> lock(ringsMutex_);
+  uint64_t dropped = 0;
+  for (const auto& ring : rings_) {
+    dropped += ring->dropped.load(std::memory_order_relaxed);
+  }
+  return dropped;
+}
+
+void Profiler::writeCsv() {
+  csv_ << std::fixed << std::setprecision(4);
+  for (size_t stage = 0; stage < kProfileStageCount; ++stage) {
+    const ProfileStats stageStats = stats(static_cast<ProfileStage>(stage));
+    if (stageStats.frames == 0) {
+      continue;
+    }
+    csv_ << frameCount_ << ',' << kStageNames[stage] << ',' << stageStats.frames << ','
+         << stageStats.p50Ms << ',' << stageStats.p95Ms << ',' << stageStats.p99Ms << ','
+         << stageStats.maxMs << '\n';
+  }
+  csv_.flush();
+}
+
+}  // namespace uvk
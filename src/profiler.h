@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace uvk {
+
+enum class ProfileStage : uint8_t {
+  Capture,
+  SurroundAnalysis,
+  SpectrumAnalysis,
+  WaterfallUpdate,
+  // Copying written rows into the staging ring.
+  Upload,
+  CommandRecording,
+  Submit,
+  Present,
+  // Blocked on frame slots, swapchain images or draw targets coming free.
+  Wait,
+  // GPU time from timestamp queries, recorded when a frame slot's results are read back.
+  // Graphics-queue uploads, including the post-process compute pass.
+  GpuUpload,
+  // Copies on the dedicated transfer queue.
+  GpuTransfer,
+  // The render pass (and the readback copy when there is one).
+  GpuDraw,
+  // One EnkiTaskScheduler task, on the thread that ran it.
+  Task,
+  // From one endFrame() to the next.
+  Frame,
+};
+
+inline constexpr size_t kProfileStageCount = 14;
+
+// Sampled values shown as counter tracks in a trace; only recorded while tracing.
+enum class ProfileCounter : uint8_t {
+  TasksPending,
+  // Submitted frames the GPU has not finished yet.
+  FramesInFlight,
+  // Resources waiting for their last submission before being freed.
+  RetiredResources,
+  GpuAllocations,
+  GpuAllocatedKiB,
+};
+
+inline constexpr size_t kProfileCounterCount = 5;
+
+[[nodiscard]] const char* profileStageName(ProfileStage stage) noexcept;
+[[nodiscard]] const char* profileCounterName(ProfileCounter counter) noexcept;
+
+// Nearest-rank percentile of non-empty ascending `sorted`; shared by every timing report so
+// the same samples always give the same p50/p95.
+template <typename T>
+[[nodiscard]] T nearestRankPercentile(const std::vector<T>& sorted, double fraction) {
+  const double rank = std::ceil(fraction * static_cast<double>(sorted.size()));
+  const size_t index = static_cast<size_t>(std::max(rank, 1.0)) - 1;
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+// Per-frame time of one stage over the sliding window, in milliseconds.
+struct ProfileStats {
+  size_t frames{};
+  double p50Ms{};
+  double p95Ms{};
+  double p99Ms{};
+  double maxMs{};
+};
+
+struct ProfilerOptions {
+  // Frames the percentiles are computed over.
+  size_t windowFrames{600};
+  // Appends every stage's statistics to this CSV file each csvIntervalFrames frames; empty
+  // disables the dump.
+  std::string csvPath;
+  size_t csvIntervalFrames{300};
+  // Keeps every span and counter sample and writes them as Chrome trace-event JSON to this
+  // file on disable() or when a flush is requested by signal; empty disables tracing.
+  std::string tracePath;
+  // Events beyond this are dropped, bounding memory on long runs (about 32 bytes each).
+  size_t traceMaxEvents{4000000};
+};
+
+// Collects scoped stage timings from any thread. Each thread writes into its own lock-free
+// ring; endFrame() drains the rings on the main thread, sums each stage per frame and keeps
+// the last windowFrames frame totals for percentiles. Until enable() is called a scope costs
+// one relaxed atomic load. While tracing, the drained samples are also kept with the id of
+// the thread that recorded them.
+class Profiler {
+ public:
+  static Profiler& instance();
+
+  // Main thread only, like endFrame() and the statistics accessors.
+  void enable(const ProfilerOptions& options);
+  // Also writes the trace, if one is being recorded.
+  void disable();
+  [[nodiscard]] bool enabled() const noexcept { return enabled_.load(std::memory_order_relaxed); }
+  [[nodiscard]] bool tracing() const noexcept { return tracing_.load(std::memory_order_relaxed); }
+
+  // Monotonic nanoseconds.
+  [[nodiscard]] static uint64_t now() noexcept;
+  // Never blocks; the sample is dropped when the calling thread's ring is full.
+  void record(ProfileStage stage, uint64_t startNs, uint64_t durationNs) noexcept;
+  void recordCounter(ProfileCounter counter, int64_t value) noexcept;
+  // Labels the calling thread in the trace.
+  void setThreadName(const std::string& name);
+  // Also writes the trace when a signal asked for it since the last frame.
+  void endFrame();
+  // Writes everything traced so far; recording continues.
+  void writeTrace();
+  // SIGUSR1 writes the trace at the next endFrame(). SIGINT and SIGTERM do the same and then
+  // terminate as they would have; a second one terminates at once. No-op where the signals do
+  // not exist.
+  static void installTraceSignalHandlers();
+
+  [[nodiscard]] ProfileStats stats(ProfileStage stage) const;
+  // p95 of each stage that has samples, on one line (the windowed app shows it in the title).
+  [[nodiscard]] std::string overlayText() const;
+  void report(std::ostream& output) const;
+  [[nodiscard]] uint64_t droppedSamples() const;
+
+ private:
+  struct Sample {
+    uint64_t startNs{};
+    // Duration of a span, or the value of a counter.
+    uint64_t value{};
+    uint32_t threadId{};
+    // A ProfileStage, or a ProfileCounter when `counter` is set.
+    uint8_t id{};
+    bool counter{false};
+  };
+
+  // Single producer (the thread holding it), single consumer (endFrame()). A thread releases
+  // its ring on exit and the next new thread takes it over, so short-lived task threads do
+  // not grow the list.
+  struct ThreadRing {
+    static constexpr uint32_t kCapacity = 1024;
+    std::array<Sample, kCapacity> samples{};
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+    std::atomic<bool> owned{false};
+    std::atomic<uint64_t> dropped{0};
+  };
+
+  struct RingLease {
+    ThreadRing* ring{nullptr};
+    ~RingLease();
+  };
+
+  Profiler() = default;
+  ThreadRing* threadRing();
+  void push(const Sample& sample) noexcept;
+  void drain();
+  void writeCsv();
+  // Small sequential id of the calling thread, stable for its lifetime.
+  static uint32_t threadId() noexcept;
+
+  static thread_local RingLease lease_;
+
+  std::atomic<bool> enabled_{false};
+  std::atomic<bool> tracing_{false};
+  ProfilerOptions options_{};
+  // Guards rings_ against threadRing() appending while another thread walks it.
+  mutable std::mutex ringsMutex_;
+  std::vector<std::unique_ptr<ThreadRing>> rings_;
+  std::array<uint64_t, kProfileStageCount> frameTotals_{};
+  std::array<bool, kProfileStageCount> frameSeen_{};
+  // Ring of per-frame totals in nanoseconds for each stage.
+  std::array<std::vector<uint64_t>, kProfileStageCount> window_;
+  std::array<size_t, kProfileStageCount> windowNext_{};
+  uint64_t lastFrameNs_{0};
+  uint64_t frameCount_{0};
+  std::ofstream csv_;
+  std::vector<Sample> trace_;
+  uint64_t traceDropped_{0};
+  uint64_t traceStartNs_{0};
+  // Guarded by ringsMutex_, since any thread may name itself.
+  std::vector<std::pair<uint32_t, std::string>> threadNames_;
+};
+
+// Times the enclosing scope as one sample of `stage`.
+class ProfileScope {
+ public:
+  explicit ProfileScope(ProfileStage stage) noexcept
+      : stage_(stage), startNs_(Profiler::instance().enabled() ? Profiler::now() : 0) {}
+  ~ProfileScope() {
+    if (startNs_ != 0) {
+      Profiler::instance().record(stage_, startNs_, Profiler::now() - startNs_);
+    }
+  }
+
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+ private:
+  ProfileStage stage_;
+  uint64_t startNs_;
+};
+
+}  // namespace uvk
+
+// Instrumentation compiles away entirely without UVK_ENABLE_PROFILER.
+#if defined(UVK_ENABLE_PROFILER)
+#define UVK_PROFILE_CONCAT_INNER(a, b) a##b
+#define UVK_PROFILE_CONCAT(a, b) UVK_PROFILE_CONCAT_INNER(a, b)
+#define UVK_PROFILE_SCOPE(stage)                                         \
+  const ::uvk::ProfileScope UVK_PROFILE_CONCAT(uvkProfileScope, __LINE__)( \
+      ::uvk::ProfileStage::stage)
+#define UVK_PROFILE_END_FRAME() ::uvk::Profiler::instance().endFrame()
+// `value` is only evaluated while tracing.
+#define UVK_PROFILE_COUNTER(name, value)                                           \
+  do {                                                                             \
+    if (::uvk::Profiler::instance().tracing()) {                                   \
+      ::uvk::Profiler::instance().recordCounter(::uvk::ProfileCounter::name,       \
+                                                static_cast<int64_t>(value));      \
+    }                                                                              \
+  } while (false)
+#else
+#define UVK_PROFILE_SCOPE(stage) static_cast<void>(0)
+#define UVK_PROFILE_END_FRAME() static_cast<void>(0)
+#define UVK_PROFILE_COUNTER(name, value) static_cast<void>(0)
+#endif
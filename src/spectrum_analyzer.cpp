@@ -1,5 +1,7 @@
 #include "spectrum_analyzer.h"
 
+#include "fixed_spectrum_analyzer.h"
+
 #include <cmath>
 
 namespace uvk {
@@ -40,6 +42,14 @@ SpectrumFrame SpectrumAnalyzer::analyze(const SurroundBlock& block, int fftSize,
     return frame;
   }
 
+  // The built-in presets have compile-time specialized kernels; anything else takes the
+  // generic path below.
+  if (block.samples.size() >= static_cast<size_t>(fftSize)) {
+    if (const FixedSpectrumKernel* kernel = findFixedSpectrumKernel(fftSize, bandEdgesHz)) {
+      return kernel->analyze(block, scheduler);
+    }
+  }
+
   const int size = std::min<int>(fftSize, static_cast<int>(block.samples.size()));
   const int binCount = size / 2;
   frame.magnitudes.assign(static_cast<size_t>(binCount), 0.0f);
@@ -1,7 +1,8 @@
 #include "visualizer.h"
 
+#include "profiler.h"
+
 #include <algorithm>
-#include <cstring>
 #include <iostream>
 
 namespace uvk {
@@ -10,21 +11,39 @@ Visualizer::~Visualizer() {
   shutdown();
 }
 
-void Visualizer::initialize(VulkanContext& context, size_t binCount, size_t historyLength) {
+void Visualizer::initialize(VulkanContext& context, size_t binCount,
+                            const WaterfallHistoryOptions& history,
+                            const BinAggregationOptions& aggregation,
+                            const WaterfallEncoding& encoding) {
   context_ = &context;
-  waterfall_.initialize(context, binCount, historyLength);
-  analysisBuffer_ = context_->createBuffer(sizeof(float) * 4,
-                                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-                                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  history_ = history;
+  aggregation_ = aggregation;
+  encoding_ = encoding;
+  waterfall_->shutdown();
+  waterfall_ = createWaterfall(binCount);
 }
 
 void Visualizer::shutdown() {
-  waterfall_.shutdown();
+  waterfall_->shutdown();
+  context_ = nullptr;
+}
+
+std::unique_ptr<WaterfallRenderer> Visualizer::createWaterfall(size_t binCount) const {
+  auto waterfall = std::make_unique<WaterfallRenderer>();
   if (context_) {
-    context_->destroyBuffer(analysisBuffer_);
+    waterfall->setPostProcess(postOptions_, pipelineCache_);
+    waterfall->initialize(*context_, binCount, history_, aggregation_, encoding_);
   }
-  context_ = nullptr;
+  return waterfall;
+}
+
+std::unique_ptr<WaterfallRenderer> Visualizer::replaceWaterfall(
+    std::unique_ptr<WaterfallRenderer> waterfall) {
+  if (!waterfall) {
+    return nullptr;
+  }
+  std::swap(waterfall_, waterfall);
+  return waterfall;
 }
 
 void Visualizer::update(const SurroundAnalysis& analysis, const SpectrumFrame& spectrum) {
@@ -33,17 +52,16 @@ void Visualizer::update(const SurroundAnalysis& analysis, const SpectrumFrame& s
   state_.elevationDegrees = analysis.elevationDegrees;
   std::transform(analysis.rms.begin(), analysis.rms.end(), state_.meterLevels.begin(),
                  [](float value) { return std::min(value, 1.0f); });
-  waterfall_.update(spectrum);
-  waterfall_.uploadToGpu();
-  state_.bounds = DifferentialMath::analyzeWaterfall(
-      waterfall_.waterfall(), waterfall_.binCount(), waterfall_.historyLength(), true);
-  if (context_ && analysisBuffer_.buffer != VK_NULL_HANDLE) {
-    void* mapped = nullptr;
-    vkMapMemory(context_->device(), analysisBuffer_.memory, 0, analysisBuffer_.size, 0, &mapped);
-    const float metrics[4] = {state_.energy, state_.azimuthDegrees, state_.elevationDegrees, 0.0f};
-    std::memcpy(mapped, metrics, sizeof(metrics));
-    vkUnmapMemory(context_->device(), analysisBuffer_.memory);
+  {
+    UVK_PROFILE_SCOPE(WaterfallUpdate);
+    waterfall_->update(spectrum);
+  }
+  {
+    UVK_PROFILE_SCOPE(Upload);
+    waterfall_->uploadToGpu();
   }
+  // Maintained incrementally as rows are written, in O(columns) per frame.
+  state_.bounds = waterfall_->differentialBounds();
 }
 
 void Visualizer::renderFrame() {
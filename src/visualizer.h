@@ -6,6 +6,7 @@
 #include "waterfall_renderer.h"
 
 #include <array>
+#include <memory>
 
 namespace uvk {
 
@@ -20,26 +21,64 @@ struct VisualizerState {
 class Visualizer {
  public:
   ~Visualizer();
-  void initialize(VulkanContext& context, size_t binCount, size_t historyLength);
+  // Must be called before initialize(); see WaterfallRenderer::setPostProcess().
+  void setPostProcess(const WaterfallPostProcessOptions& options, PipelineCache* pipelineCache) {
+    postOptions_ = options;
+    pipelineCache_ = pipelineCache;
+  }
+  void initialize(VulkanContext& context, size_t binCount,
+                  const WaterfallHistoryOptions& history,
+                  const BinAggregationOptions& aggregation = {},
+                  const WaterfallEncoding& encoding = {});
   void shutdown();
   void update(const SurroundAnalysis& analysis, const SpectrumFrame& spectrum);
   void renderFrame();
+  bool recordUploads(const UploadCommands& commands) { return waterfall_->recordUpload(commands); }
+
+  // A waterfall for `binCount` analysis bins with the options given to initialize(). Leaves
+  // the current waterfall alone, so it can run on a worker thread while frames render.
+  [[nodiscard]] std::unique_ptr<WaterfallRenderer> createWaterfall(size_t binCount) const;
+  // Makes `waterfall` current and returns the previous one, which frames still in flight may
+  // be reading; shut it down once they have completed.
+  std::unique_ptr<WaterfallRenderer> replaceWaterfall(
+      std::unique_ptr<WaterfallRenderer> waterfall);
 
   [[nodiscard]] const VisualizerState& state() const noexcept { return state_; }
   [[nodiscard]] const VulkanBuffer& waterfallBuffer() const noexcept {
-    return waterfall_.buffer();
+    return waterfall_->buffer();
+  }
+  // Energy, azimuth and elevation as consumed by the vertex shader's FrameData.metrics.
+  [[nodiscard]] std::array<float, 4> analysisMetrics() const noexcept {
+    return {state_.energy, state_.azimuthDegrees, state_.elevationDegrees, 0.0f};
+  }
+  // Display columns per row after aggregation.
+  [[nodiscard]] size_t waterfallBinCount() const noexcept { return waterfall_->binCount(); }
+  [[nodiscard]] const WaterfallLayout& waterfallLayout() const noexcept {
+    return waterfall_->layout();
+  }
+  [[nodiscard]] const std::array<size_t, kMaxWaterfallTiers>& waterfallHeads() const noexcept {
+    return waterfall_->tierHeads();
+  }
+  [[nodiscard]] size_t waterfallCopy() const noexcept { return waterfall_->historyCopy(); }
+  [[nodiscard]] WaterfallStatistics scanWaterfall(size_t bandCount,
+                                                  EnkiTaskScheduler* scheduler) const {
+    return waterfall_->scanHistory(bandCount, scheduler);
   }
-  [[nodiscard]] const VulkanBuffer& analysisBuffer() const noexcept { return analysisBuffer_; }
-  [[nodiscard]] size_t waterfallBinCount() const noexcept { return waterfall_.binCount(); }
-  [[nodiscard]] size_t waterfallHistoryLength() const noexcept {
-    return waterfall_.historyLength();
+  // Input rows covered by the whole history, across all tiers.
+  [[nodiscard]] size_t waterfallHistorySpan() const noexcept {
+    return waterfall_->historySpan();
   }
 
  private:
   VulkanContext* context_{nullptr};
   VisualizerState state_{};
-  WaterfallRenderer waterfall_;
-  VulkanBuffer analysisBuffer_{};
+  WaterfallHistoryOptions history_{};
+  BinAggregationOptions aggregation_{};
+  WaterfallEncoding encoding_{};
+  WaterfallPostProcessOptions postOptions_{};
+  PipelineCache* pipelineCache_{nullptr};
+  // Never null; replaced whole when the analysis resolution changes.
+  std::unique_ptr<WaterfallRenderer> waterfall_{std::make_unique<WaterfallRenderer>()};
 };
 
 }  // namespace uvk
@@ -1,10 +1,18 @@
 #pragma once
 
+#include <array>
 #include <string>
 #include <vector>
 
 namespace uvk {
 
+// Band tables of the built-in presets; fixed_spectrum_analyzer.cpp specializes on them.
+inline constexpr std::array<float, 7> kWidebandBandEdgesHz{20.0f,   60.0f,    250.0f, 1000.0f,
+                                                           4000.0f, 12000.0f, 20000.0f};
+inline constexpr std::array<float, 5> kSubwooferBandEdgesHz{20.0f, 40.0f, 80.0f, 120.0f, 200.0f};
+inline constexpr std::array<float, 6> kPresenceBandEdgesHz{200.0f,  500.0f,  1000.0f,
+                                                           2500.0f, 5000.0f, 8000.0f};
+
 struct SpectrumPreset {
   std::string name;
   int fftSize;
@@ -12,15 +20,15 @@ struct SpectrumPreset {
 };
 
 inline SpectrumPreset makeWidebandPreset() {
-  return {"Wideband", 512, {20.0f, 60.0f, 250.0f, 1000.0f, 4000.0f, 12000.0f, 20000.0f}};
+  return {"Wideband", 512, {kWidebandBandEdgesHz.begin(), kWidebandBandEdgesHz.end()}};
 }
 
 inline SpectrumPreset makeSubwooferPreset() {
-  return {"Subwoofer", 256, {20.0f, 40.0f, 80.0f, 120.0f, 200.0f}};
+  return {"Subwoofer", 256, {kSubwooferBandEdgesHz.begin(), kSubwooferBandEdgesHz.end()}};
 }
 
 inline SpectrumPreset makePresencePreset() {
-  return {"Presence", 512, {200.0f, 500.0f, 1000.0f, 2500.0f, 5000.0f, 8000.0f}};
+  return {"Presence", 512, {kPresenceBandEdgesHz.begin(), kPresenceBandEdgesHz.end()}};
 }
 
 inline std::vector<SpectrumPreset> availablePresets() {
@@ -1,6 +1,12 @@
 #include "vulkan_app.h"
 
+#include "profiler.h"
+#include "waterfall_mesh.h"
+
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <stdexcept>
@@ -43,6 +49,64 @@ VkExtent2D chooseExtent(const VkSurfaceCapabilitiesKHR& capabilities, GLFWwindow
   return extent;
 }
 
+void reportStage(const char* label, ProfileStage stage) {
+  const ProfileStats stats = Profiler::instance().stats(stage);
+  if (stats.frames == 0) {
+    return;
+  }
+  std::cout << label << ": p50 " << stats.p50Ms << " ms | p95 " << stats.p95Ms << " ms | p99 "
+            << stats.p99Ms << " ms | max " << stats.maxMs << " ms\n";
+}
+
+struct SurfaceIndices {
+  std::vector<unsigned char> bytes;
+  uint32_t count{0};
+  VkIndexType type{VK_INDEX_TYPE_UINT32};
+  size_t vertexCount{0};
+  size_t stripCount{0};
+};
+
+SurfaceIndices buildSurfaceIndices(const WaterfallLayout& layout) {
+  // The mesh spans logical rows, so it runs straight across tier boundaries; the shader
+  // maps each row to its tier's ring.
+  const WaterfallMesh mesh = buildWaterfallMesh(layout.binCount, layout.rowCount());
+  SurfaceIndices surface;
+  surface.count = static_cast<uint32_t>(mesh.indices.size());
+  surface.vertexCount = mesh.vertexCount;
+  surface.stripCount = mesh.stripCount;
+  // 16-bit indices halve the index fetch whenever every vertex and the restart value fit.
+  if (layout.binCount * layout.rowCount() < 0xFFFF) {
+    std::vector<uint16_t> narrow(mesh.indices.size());
+    for (size_t i = 0; i < narrow.size(); ++i) {
+      narrow[i] = mesh.indices[i] == kPrimitiveRestartIndex
+                      ? static_cast<uint16_t>(0xFFFF)
+                      : static_cast<uint16_t>(mesh.indices[i]);
+    }
+    surface.type = VK_INDEX_TYPE_UINT16;
+    surface.bytes.resize(sizeof(uint16_t) * narrow.size());
+    std::memcpy(surface.bytes.data(), narrow.data(), surface.bytes.size());
+  } else {
+    surface.bytes.resize(sizeof(uint32_t) * mesh.indices.size());
+    std::memcpy(surface.bytes.data(), mesh.indices.data(), surface.bytes.size());
+  }
+  return surface;
+}
+
+// Timestamp queries of one frame slot in the profiler's query pool.
+constexpr uint32_t kQueryUploadBegin = 0;
+constexpr uint32_t kQueryUploadEnd = 1;
+constexpr uint32_t kQueryDrawEnd = 2;
+constexpr uint32_t kQueryTransferBegin = 3;
+constexpr uint32_t kQueryTransferEnd = 4;
+constexpr uint32_t kQueriesPerFrame = 5;
+
+uint64_t timestampMask(uint32_t validBits) {
+  if (validBits == 0) {
+    return 0;
+  }
+  return validBits >= 64 ? ~uint64_t{0} : (uint64_t{1} << validBits) - 1;
+}
+
 }  // namespace
 
 VulkanApp::~VulkanApp() {
@@ -61,57 +125,233 @@ void VulkanApp::initialize(const std::string& title, int width, int height) {
   context_.initializeInstance(title, instanceExtensions);
   createSurface();
   context_.initializeDeviceWithSurface(surface_, deviceExtensions);
+  pipelineCache_.initialize(context_, pipelineCachePath_);
   createSwapchain();
   createImageViews();
   createDepthResources();
   createRenderPass();
   createDescriptorSetLayout();
+  createPipelineLayout();
+  // Compiles while the framebuffers, command buffers and the caller's own setup proceed.
   createPipeline();
   createFramebuffers();
   createCommandPool();
-  createCommandBuffers();
-  createSyncObjects();
+  createFrameResources();
+  createDrawTargets();
   initialized_ = true;
 }
 
-void VulkanApp::setWaterfallSource(const VulkanBuffer& buffer, size_t binCount,
-                                   size_t historyLength) {
+void VulkanApp::initializeOffscreen(const std::string& title, const OffscreenOptions& options) {
+  offscreen_ = true;
+  offscreenOptions_ = options;
+  context_.initialize(title);
+  pipelineCache_.initialize(context_, pipelineCachePath_);
+  createOffscreenTarget();
+  createImageViews();
+  createDepthResources();
+  createRenderPass();
+  createDescriptorSetLayout();
+  createPipelineLayout();
+  // Compiles while the framebuffers, command buffers and the caller's own setup proceed.
+  createPipeline();
+  createFramebuffers();
+  createCommandPool();
+  createFrameResources();
+  if (!offscreenOptions_.readbackPath.empty()) {
+    readbackBuffer_ = context_.createBuffer(
+        static_cast<VkDeviceSize>(swapchainExtent_.width) * swapchainExtent_.height * 4,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+  }
+  createDrawTargets();
+  initialized_ = true;
+}
+
+void VulkanApp::setWaterfallSource(const VulkanBuffer& buffer, const WaterfallLayout& layout) {
   waterfallBuffer_ = buffer;
-  waterfallBinCount_ = binCount;
-  waterfallHistoryLength_ = historyLength;
+  waterfallLayout_ = layout;
+  waterfallHeads_.fill(0);
+  waterfallCopy_ = 0;
   if (descriptorSetLayout_ == VK_NULL_HANDLE) {
     createDescriptorSetLayout();
   }
   if (descriptorPool_ == VK_NULL_HANDLE) {
     createDescriptorPool();
   }
-  createDescriptorSet();
+  createDescriptorSets();
+  createWaterfallMesh();
+  // The vertex count is baked into the pre-recorded draws.
+  ++drawGeneration_;
 }
 
-void VulkanApp::setAnalysisSource(const VulkanBuffer& buffer) {
-  analysisBuffer_ = buffer;
-  if (descriptorSetLayout_ == VK_NULL_HANDLE) {
-    createDescriptorSetLayout();
+void VulkanApp::setDrawMode(WaterfallDrawMode mode) {
+  if (mode != drawMode_) {
+    drawMode_ = mode;
+    ++drawGeneration_;
   }
-  if (descriptorPool_ == VK_NULL_HANDLE) {
-    createDescriptorPool();
+}
+
+void VulkanApp::createWaterfallMesh() {
+  if (context_.device() == VK_NULL_HANDLE || commandPool_ == VK_NULL_HANDLE) {
+    return;
+  }
+  if (meshIndexBuffer_.buffer != VK_NULL_HANDLE) {
+    vkDeviceWaitIdle(context_.device());
+    context_.destroyBuffer(meshIndexBuffer_);
+    context_.destroyBuffer(meshIndexStaging_);
+  }
+  meshIndexCount_ = 0;
+  const SurfaceIndices surface = buildSurfaceIndices(waterfallLayout_);
+  if (surface.count == 0) {
+    return;
+  }
+  meshIndexType_ = surface.type;
+  meshIndexBuffer_ = createStaticBuffer(surface.bytes.data(), surface.bytes.size(),
+                                        VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+  meshIndexCount_ = surface.count;
+  std::cout << "Waterfall mesh: " << surface.vertexCount << " of "
+            << waterfallLayout_.binCount * waterfallLayout_.rowCount() << " grid vertices, "
+            << surface.stripCount << " strips, " << meshIndexCount_ << " indices\n";
+}
+
+PreparedWaterfallSource VulkanApp::prepareWaterfallSource(const VulkanBuffer& buffer,
+                                                          const WaterfallLayout& layout) {
+  PreparedWaterfallSource source;
+  source.waterfall = buffer;
+  source.layout = layout;
+  const SurfaceIndices surface = buildSurfaceIndices(layout);
+  if (surface.count == 0) {
+    return source;
+  }
+  // The allocator is thread-safe; the copy itself waits for the frame that first needs it.
+  source.indexStaging = context_.createBuffer(surface.bytes.size(),
+                                              VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                              AllocationStrategy::Linear);
+  std::memcpy(source.indexStaging.mapped, surface.bytes.data(), surface.bytes.size());
+  context_.flushBuffer(source.indexStaging);
+  source.indices = context_.createBuffer(
+      surface.bytes.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  source.indexCount = surface.count;
+  source.indexType = surface.type;
+  return source;
+}
+
+void VulkanApp::switchWaterfallSource(PreparedWaterfallSource source,
+                                      std::function<void()> retire) {
+  // Frames already submitted keep drawing from the old buffers through their own descriptor
+  // sets and pre-recorded draws, so those stay alive until the last of them completes.
+  VulkanBuffer oldIndices = meshIndexBuffer_;
+  VulkanBuffer oldStaging = meshIndexStaging_;
+  this->retire([this, oldIndices, oldStaging, release = std::move(retire)]() mutable {
+    context_.destroyBuffer(oldIndices);
+    context_.destroyBuffer(oldStaging);
+    if (release) {
+      release();
+    }
+  });
+  waterfallBuffer_ = source.waterfall;
+  waterfallLayout_ = source.layout;
+  waterfallHeads_.fill(0);
+  waterfallCopy_ = 0;
+  meshIndexBuffer_ = source.indices;
+  meshIndexStaging_ = source.indexStaging;
+  meshIndexCount_ = source.indexCount;
+  meshIndexType_ = source.indexType;
+  ++drawGeneration_;
+}
+
+void VulkanApp::retire(std::function<void()> release) {
+  retired_.push_back({timelineValue_, std::move(release)});
+}
+
+void VulkanApp::releaseRetired() {
+  // Entries are pushed in submission order, so the completed ones are a prefix.
+  size_t released = 0;
+  while (released < retired_.size() && retired_[released].timelineValue <= completedValue_) {
+    retired_[released].release();
+    ++released;
   }
-  createDescriptorSet();
+  retired_.erase(retired_.begin(), retired_.begin() + static_cast<std::ptrdiff_t>(released));
+}
+
+VulkanBuffer VulkanApp::createStaticBuffer(const void* data, VkDeviceSize size,
+                                           VkBufferUsageFlags usage) {
+  VulkanBuffer staging = context_.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                               AllocationStrategy::Linear);
+  std::memcpy(staging.mapped, data, static_cast<size_t>(size));
+  context_.flushBuffer(staging);
+  VulkanBuffer buffer = context_.createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  // Static data is uploaded once per size, so a blocking one-off submission is fine here.
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = commandPool_;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+  VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+  if (vkAllocateCommandBuffers(context_.device(), &allocInfo, &commandBuffer) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate command buffers.");
+  }
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vkBeginCommandBuffer(commandBuffer, &beginInfo);
+  VkBufferCopy region{};
+  region.size = size;
+  vkCmdCopyBuffer(commandBuffer, staging.buffer, buffer.buffer, 1, &region);
+  vkEndCommandBuffer(commandBuffer);
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+  if (vkQueueSubmit(context_.graphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to submit static buffer upload.");
+  }
+  // Waiting for the queue also makes the copy visible to every later submission.
+  vkQueueWaitIdle(context_.graphicsQueue());
+  vkFreeCommandBuffers(context_.device(), commandPool_, 1, &commandBuffer);
+  context_.destroyBuffer(staging);
+  return buffer;
+}
+
+void VulkanApp::setFramesInFlight(size_t count) {
+  framesInFlight_ = std::clamp<size_t>(count, 1, kMaxFramesInFlight);
 }
 
 void VulkanApp::run(const std::function<void()>& perFrame) {
+  if (offscreen_) {
+    runOffscreen(perFrame);
+    return;
+  }
   while (window_ && !glfwWindowShouldClose(window_)) {
     glfwPollEvents();
     if (perFrame) {
       perFrame();
     }
     drawFrame();
+    UVK_PROFILE_END_FRAME();
+    updateProfileOverlay();
   }
   if (context_.device() != VK_NULL_HANDLE) {
     vkDeviceWaitIdle(context_.device());
   }
 }
 
+void VulkanApp::renderFrame() {
+  if (offscreen_) {
+    drawOffscreenFrame(false);
+    return;
+  }
+  if (window_) {
+    glfwPollEvents();
+    drawFrame();
+  }
+}
+
 void VulkanApp::shutdown() {
   if (!initialized_) {
     return;
@@ -120,27 +360,52 @@ void VulkanApp::shutdown() {
   if (device != VK_NULL_HANDLE) {
     vkDeviceWaitIdle(device);
   }
-  if (imageAvailableSemaphore_ != VK_NULL_HANDLE) {
-    vkDestroySemaphore(device, imageAvailableSemaphore_, nullptr);
-  }
-  if (renderFinishedSemaphore_ != VK_NULL_HANDLE) {
-    vkDestroySemaphore(device, renderFinishedSemaphore_, nullptr);
-  }
-  if (inFlightFence_ != VK_NULL_HANDLE) {
-    vkDestroyFence(device, inFlightFence_, nullptr);
-  }
+  completedValue_ = timelineValue_;
+  releaseRetired();
+  destroyDrawTargets();
+  destroyFrameResources();
   if (commandPool_ != VK_NULL_HANDLE) {
     vkDestroyCommandPool(device, commandPool_, nullptr);
+    commandPool_ = VK_NULL_HANDLE;
+  }
+  if (transferCommandPool_ != VK_NULL_HANDLE) {
+    vkDestroyCommandPool(device, transferCommandPool_, nullptr);
+    transferCommandPool_ = VK_NULL_HANDLE;
   }
   if (descriptorPool_ != VK_NULL_HANDLE) {
     vkDestroyDescriptorPool(device, descriptorPool_, nullptr);
     descriptorPool_ = VK_NULL_HANDLE;
   }
+  if (pipelineBuild_.valid()) {
+    try {
+      graphicsPipelines_ = pipelineBuild_.get();
+    } catch (const std::exception&) {
+      graphicsPipelines_ = {};
+    }
+  }
   if (descriptorSetLayout_ != VK_NULL_HANDLE) {
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout_, nullptr);
     descriptorSetLayout_ = VK_NULL_HANDLE;
   }
   cleanupSwapchain();
+  if (pipelineLayout_ != VK_NULL_HANDLE) {
+    vkDestroyPipelineLayout(device, pipelineLayout_, nullptr);
+    pipelineLayout_ = VK_NULL_HANDLE;
+  }
+  pipelineCache_.shutdown();
+  context_.destroyBuffer(readbackBuffer_);
+  context_.destroyBuffer(meshIndexBuffer_);
+  context_.destroyBuffer(meshIndexStaging_);
+  meshIndexCount_ = 0;
+  if (offscreenImage_ != VK_NULL_HANDLE) {
+    vkDestroyImage(device, offscreenImage_, nullptr);
+    offscreenImage_ = VK_NULL_HANDLE;
+  }
+  if (offscreenImageMemory_ != VK_NULL_HANDLE) {
+    vkFreeMemory(device, offscreenImageMemory_, nullptr);
+    offscreenImageMemory_ = VK_NULL_HANDLE;
+  }
+  swapchainImages_.clear();
   if (surface_ != VK_NULL_HANDLE && context_.instance() != VK_NULL_HANDLE) {
     vkDestroySurfaceKHR(context_.instance(), surface_, nullptr);
     surface_ = VK_NULL_HANDLE;
@@ -151,6 +416,7 @@ void VulkanApp::shutdown() {
     window_ = nullptr;
     glfwTerminate();
   }
+  transferRecorder_ = nullptr;
   initialized_ = false;
 }
 
@@ -159,10 +425,25 @@ void VulkanApp::initWindow(const std::string& title, int width, int height) {
     throw std::runtime_error("Failed to initialize GLFW.");
   }
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+  title_ = title;
   window_ = glfwCreateWindow(width, height, title.c_str(), nullptr, nullptr);
   if (!window_) {
     throw std::runtime_error("Failed to create GLFW window.");
   }
+  glfwSetWindowUserPointer(window_, this);
+  glfwSetKeyCallback(window_, [](GLFWwindow* window, int key, int, int action, int) {
+    auto* app = static_cast<VulkanApp*>(glfwGetWindowUserPointer(window));
+    if (action != GLFW_PRESS) {
+      return;
+    }
+    if (key == GLFW_KEY_F3) {
+      app->profileOverlay_ = !app->profileOverlay_;
+      app->overlayFrame_ = 0;
+      glfwSetWindowTitle(window, app->title_.c_str());
+    } else if (app->keyHandler_) {
+      app->keyHandler_(key);
+    }
+  });
 }
 
 void VulkanApp::createSurface() {
@@ -221,10 +502,19 @@ void VulkanApp::createSwapchain() {
   createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
   createInfo.presentMode = presentMode;
   createInfo.clipped = VK_TRUE;
+  // Handing over the old swapchain lets the driver reuse its resources. recreateSwapchain()
+  // has already idled the device, so nothing uses the old one when it is destroyed below.
+  const VkSwapchainKHR oldSwapchain = swapchain_;
+  createInfo.oldSwapchain = oldSwapchain;
 
-  if (vkCreateSwapchainKHR(context_.device(), &createInfo, nullptr, &swapchain_) != VK_SUCCESS) {
+  VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+  if (vkCreateSwapchainKHR(context_.device(), &createInfo, nullptr, &swapchain) != VK_SUCCESS) {
     throw std::runtime_error("Failed to create swapchain.");
   }
+  if (oldSwapchain != VK_NULL_HANDLE) {
+    vkDestroySwapchainKHR(context_.device(), oldSwapchain, nullptr);
+  }
+  swapchain_ = swapchain;
 
   vkGetSwapchainImagesKHR(context_.device(), swapchain_, &imageCount, nullptr);
   swapchainImages_.resize(imageCount);
@@ -233,6 +523,49 @@ void VulkanApp::createSwapchain() {
   swapchainExtent_ = extent;
 }
 
+void VulkanApp::createOffscreenTarget() {
+  swapchainImageFormat_ = VK_FORMAT_R8G8B8A8_UNORM;
+  swapchainExtent_ = {offscreenOptions_.width, offscreenOptions_.height};
+
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent.width = swapchainExtent_.width;
+  imageInfo.extent.height = swapchainExtent_.height;
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = 1;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = swapchainImageFormat_;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  if (vkCreateImage(context_.device(), &imageInfo, nullptr, &offscreenImage_) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create offscreen color image.");
+  }
+
+  VkMemoryRequirements memRequirements;
+  vkGetImageMemoryRequirements(context_.device(), offscreenImage_, &memRequirements);
+
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = memRequirements.size;
+  allocInfo.memoryTypeIndex = context_.findMemoryType(memRequirements.memoryTypeBits,
+                                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  if (vkAllocateMemory(context_.device(), &allocInfo, nullptr, &offscreenImageMemory_) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate offscreen color image memory.");
+  }
+  vkBindImageMemory(context_.device(), offscreenImage_, offscreenImageMemory_, 0);
+
+  // The offscreen image stands in for a single-image swapchain so the rest of the
+  // render path (views, framebuffers, command buffers) is shared unchanged.
+  swapchainImages_ = {offscreenImage_};
+}
+
 void VulkanApp::createImageViews() {
   swapchainImageViews_.resize(swapchainImages_.size());
   for (size_t i = 0; i < swapchainImages_.size(); ++i) {
@@ -267,7 +600,8 @@ void VulkanApp::createRenderPass() {
   colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  colorAttachment.finalLayout =
+      offscreen_ ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
   VkAttachmentDescription depthAttachment{};
   depthAttachment.format = VK_FORMAT_D32_SFLOAT;
@@ -298,7 +632,11 @@ void VulkanApp::createRenderPass() {
   dependency.dstSubpass = 0;
   dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
                             VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-  dependency.srcAccessMask = 0;
+  // Frames in flight share the depth attachment (and, offscreen, the color image), so the
+  // previous frame's attachment writes must finish before this frame clears them.
+  dependency.srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependency.srcAccessMask =
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
   dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
                             VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
   dependency.dstAccessMask =
@@ -330,13 +668,13 @@ void VulkanApp::createDescriptorSetLayout() {
   waterfallBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
   waterfallBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
-  VkDescriptorSetLayoutBinding analysisBinding{};
-  analysisBinding.binding = 1;
-  analysisBinding.descriptorCount = 1;
-  analysisBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-  analysisBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+  VkDescriptorSetLayoutBinding frameBinding{};
+  frameBinding.binding = 1;
+  frameBinding.descriptorCount = 1;
+  frameBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  frameBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 
-  VkDescriptorSetLayoutBinding bindings[] = {waterfallBinding, analysisBinding};
+  VkDescriptorSetLayoutBinding bindings[] = {waterfallBinding, frameBinding};
 
   VkDescriptorSetLayoutCreateInfo layoutInfo{};
   layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -353,15 +691,16 @@ void VulkanApp::createDescriptorPool() {
   if (descriptorPool_ != VK_NULL_HANDLE) {
     return;
   }
+  const uint32_t setCount = static_cast<uint32_t>(std::max<size_t>(1, drawTargets_.size()));
   VkDescriptorPoolSize poolSizes[2]{};
   poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-  poolSizes[0].descriptorCount = 1;
-  poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-  poolSizes[1].descriptorCount = 1;
+  poolSizes[0].descriptorCount = setCount;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  poolSizes[1].descriptorCount = setCount;
 
   VkDescriptorPoolCreateInfo poolInfo{};
   poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-  poolInfo.maxSets = 1;
+  poolInfo.maxSets = setCount;
   poolInfo.poolSizeCount = 2;
   poolInfo.pPoolSizes = poolSizes;
 
@@ -371,59 +710,107 @@ void VulkanApp::createDescriptorPool() {
   }
 }
 
-void VulkanApp::createDescriptorSet() {
+void VulkanApp::createDescriptorSets() {
   if (descriptorPool_ == VK_NULL_HANDLE || descriptorSetLayout_ == VK_NULL_HANDLE ||
-      waterfallBuffer_.buffer == VK_NULL_HANDLE || analysisBuffer_.buffer == VK_NULL_HANDLE) {
+      waterfallBuffer_.buffer == VK_NULL_HANDLE || frameDataBuffer_.buffer == VK_NULL_HANDLE) {
     return;
   }
 
-  // Prevent double-allocation if already created
-  if (descriptorSet_ == VK_NULL_HANDLE) {
-    VkDescriptorSetAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = descriptorPool_;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &descriptorSetLayout_;
-
-    if (vkAllocateDescriptorSets(context_.device(), &allocInfo, &descriptorSet_) != VK_SUCCESS) {
-      throw std::runtime_error("Failed to allocate descriptor set.");
+  // One set per draw target: the waterfall is shared, each target reads its own frame data.
+  for (size_t i = 0; i < drawTargets_.size(); ++i) {
+    DrawTarget& target = drawTargets_[i];
+    if (target.descriptorSet == VK_NULL_HANDLE) {
+      VkDescriptorSetAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+      allocInfo.descriptorPool = descriptorPool_;
+      allocInfo.descriptorSetCount = 1;
+      allocInfo.pSetLayouts = &descriptorSetLayout_;
+
+      if (vkAllocateDescriptorSets(context_.device(), &allocInfo, &target.descriptorSet) !=
+          VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate descriptor set.");
+      }
     }
+    writeDescriptorSet(i);
   }
+}
 
+void VulkanApp::writeDescriptorSet(size_t targetIndex) {
+  DrawTarget& target = drawTargets_[targetIndex];
   VkDescriptorBufferInfo bufferInfo{};
   bufferInfo.buffer = waterfallBuffer_.buffer;
   bufferInfo.offset = 0;
   bufferInfo.range = waterfallBuffer_.size;
 
-  VkDescriptorBufferInfo analysisInfo{};
-  analysisInfo.buffer = analysisBuffer_.buffer;
-  analysisInfo.offset = 0;
-  analysisInfo.range = analysisBuffer_.size;
+  VkDescriptorBufferInfo frameInfo{};
+  frameInfo.buffer = frameDataBuffer_.buffer;
+  frameInfo.offset = frameDataStride_ * targetIndex;
+  frameInfo.range = sizeof(FrameData);
 
   VkWriteDescriptorSet descriptorWrites[2]{};
   descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-  descriptorWrites[0].dstSet = descriptorSet_;
+  descriptorWrites[0].dstSet = target.descriptorSet;
   descriptorWrites[0].dstBinding = 0;
   descriptorWrites[0].descriptorCount = 1;
   descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
   descriptorWrites[0].pBufferInfo = &bufferInfo;
 
   descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-  descriptorWrites[1].dstSet = descriptorSet_;
+  descriptorWrites[1].dstSet = target.descriptorSet;
   descriptorWrites[1].dstBinding = 1;
   descriptorWrites[1].descriptorCount = 1;
-  descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-  descriptorWrites[1].pBufferInfo = &analysisInfo;
+  descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  descriptorWrites[1].pBufferInfo = &frameInfo;
 
   vkUpdateDescriptorSets(context_.device(), 2, descriptorWrites, 0, nullptr);
+  target.generation = drawGeneration_;
+}
+
+void VulkanApp::createPipelineLayout() {
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout_;
+
+  if (vkCreatePipelineLayout(context_.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout_) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create pipeline layout.");
+  }
 }
 
 void VulkanApp::createPipeline() {
-  const auto vertShaderCode = readFile("shaders/waterfall.vert.spv");
-  const auto fragShaderCode = readFile("shaders/waterfall.frag.spv");
+  waitForPipeline();
+  pipelineBuild_ = std::async(std::launch::async,
+                              [this, renderPass = renderPass_]() {
+                                return buildGraphicsPipelines(renderPass);
+                              });
+}
+
+void VulkanApp::waitForPipeline() {
+  if (!pipelineBuild_.valid()) {
+    return;
+  }
+  graphicsPipelines_ = pipelineBuild_.get();
+  if (!pipelineReported_) {
+    pipelineReported_ = true;
+    std::cout << "Pipeline: built in " << pipelineBuildMs_ << " ms (";
+    if (pipelineCache_.loadedBytes() > 0) {
+      std::cout << "warm cache, " << pipelineCache_.loadedBytes() << " bytes from "
+                << pipelineCache_.path();
+    } else {
+      std::cout << "cold cache";
+    }
+    std::cout << ")\n";
+  }
+}
 
-  VkShaderModule vertModule = createShaderModule(vertShaderCode);
-  VkShaderModule fragModule = createShaderModule(fragShaderCode);
+// Only touches its arguments, pipelineLayout_ and the internally synchronized pipeline cache,
+// so it can run on the compile thread while the main thread keeps creating resources. Every
+// draw mode is built in one batch; they differ only in input assembly.
+VulkanApp::GraphicsPipelines VulkanApp::buildGraphicsPipelines(VkRenderPass renderPass) {
+  const auto start = std::chrono::steady_clock::now();
+  VkShaderModule vertModule = pipelineCache_.shaderModule("waterfall.vert.spv");
+  VkShaderModule fragModule = pipelineCache_.shaderModule("waterfall.frag.spv");
 
   VkPipelineShaderStageCreateInfo vertStage{};
   vertStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -442,29 +829,25 @@ void VulkanApp::createPipeline() {
   VkPipelineVertexInputStateCreateInfo vertexInput{};
   vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-  VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-  inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-  inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
-  inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-  VkViewport viewport{};
-  viewport.x = 0.0f;
-  viewport.y = 0.0f;
-  viewport.width = static_cast<float>(swapchainExtent_.width);
-  viewport.height = static_cast<float>(swapchainExtent_.height);
-  viewport.minDepth = 0.0f;
-  viewport.maxDepth = 1.0f;
-
-  VkRect2D scissor{};
-  scissor.offset = {0, 0};
-  scissor.extent = swapchainExtent_;
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly[kWaterfallDrawModeCount]{};
+  inputAssembly[0].sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssembly[0].topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+  inputAssembly[0].primitiveRestartEnable = VK_FALSE;
+  inputAssembly[1].sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssembly[1].topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+  inputAssembly[1].primitiveRestartEnable = VK_TRUE;
 
+  // Viewport and scissor are set while recording, so a resize does not invalidate the pipeline.
   VkPipelineViewportStateCreateInfo viewportState{};
   viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
   viewportState.viewportCount = 1;
-  viewportState.pViewports = &viewport;
   viewportState.scissorCount = 1;
-  viewportState.pScissors = &scissor;
+
+  const VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamicState{};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = 2;
+  dynamicState.pDynamicStates = dynamicStates;
 
   VkPipelineRasterizationStateCreateInfo rasterizer{};
   rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -501,45 +884,42 @@ void VulkanApp::createPipeline() {
   colorBlending.attachmentCount = 1;
   colorBlending.pAttachments = &colorBlendAttachment;
 
-  VkPushConstantRange pushConstant{};
-  pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-  pushConstant.offset = 0;
-  pushConstant.size = sizeof(float) * 20;
-
-  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutInfo.setLayoutCount = 1;
-  pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout_;
-  pipelineLayoutInfo.pushConstantRangeCount = 1;
-  pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
-
-  if (vkCreatePipelineLayout(context_.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout_) !=
-      VK_SUCCESS) {
-    throw std::runtime_error("Failed to create pipeline layout.");
-  }
-
   VkGraphicsPipelineCreateInfo pipelineInfo{};
   pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineInfo.stageCount = 2;
   pipelineInfo.pStages = shaderStages;
   pipelineInfo.pVertexInputState = &vertexInput;
-  pipelineInfo.pInputAssemblyState = &inputAssembly;
+  pipelineInfo.pInputAssemblyState = &inputAssembly[0];
   pipelineInfo.pViewportState = &viewportState;
   pipelineInfo.pRasterizationState = &rasterizer;
   pipelineInfo.pMultisampleState = &multisampling;
   pipelineInfo.pDepthStencilState = &depthStencil;
   pipelineInfo.pColorBlendState = &colorBlending;
+  pipelineInfo.pDynamicState = &dynamicState;
   pipelineInfo.layout = pipelineLayout_;
-  pipelineInfo.renderPass = renderPass_;
+  pipelineInfo.renderPass = renderPass;
   pipelineInfo.subpass = 0;
 
-  if (vkCreateGraphicsPipelines(context_.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr,
-                                &graphicsPipeline_) != VK_SUCCESS) {
-    throw std::runtime_error("Failed to create graphics pipeline.");
+  VkGraphicsPipelineCreateInfo pipelineInfos[kWaterfallDrawModeCount];
+  for (size_t i = 0; i < kWaterfallDrawModeCount; ++i) {
+    pipelineInfos[i] = pipelineInfo;
+    pipelineInfos[i].pInputAssemblyState = &inputAssembly[i];
   }
 
-  vkDestroyShaderModule(context_.device(), fragModule, nullptr);
-  vkDestroyShaderModule(context_.device(), vertModule, nullptr);
+  GraphicsPipelines pipelines{};
+  if (vkCreateGraphicsPipelines(context_.device(), pipelineCache_.handle(),
+                                static_cast<uint32_t>(kWaterfallDrawModeCount), pipelineInfos,
+                                nullptr, pipelines.data()) != VK_SUCCESS) {
+    for (auto pipeline : pipelines) {
+      if (pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(context_.device(), pipeline, nullptr);
+      }
+    }
+    throw std::runtime_error("Failed to create graphics pipeline.");
+  }
+  pipelineBuildMs_ =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return pipelines;
 }
 
 void VulkanApp::createDepthResources() {
@@ -625,23 +1005,31 @@ void VulkanApp::createCommandPool() {
   if (vkCreateCommandPool(context_.device(), &poolInfo, nullptr, &commandPool_) != VK_SUCCESS) {
     throw std::runtime_error("Failed to create command pool.");
   }
+  if (context_.dedicatedTransferQueue()) {
+    poolInfo.queueFamilyIndex = context_.transferFamilyIndex();
+    if (vkCreateCommandPool(context_.device(), &poolInfo, nullptr, &transferCommandPool_) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("Failed to create transfer command pool.");
+    }
+    std::cout << "Uploads: transfer queue family " << context_.transferFamilyIndex() << '\n';
+  }
 }
 
-void VulkanApp::createCommandBuffers() {
-  commandBuffers_.resize(swapchainFramebuffers_.size());
+void VulkanApp::createFrameResources() {
+  VkDevice device = context_.device();
+  frames_.resize(framesInFlight_);
+  currentFrame_ = 0;
+
+  std::vector<VkCommandBuffer> commandBuffers(frames_.size());
   VkCommandBufferAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
   allocInfo.commandPool = commandPool_;
   allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers_.size());
-
-  if (vkAllocateCommandBuffers(context_.device(), &allocInfo, commandBuffers_.data()) !=
-      VK_SUCCESS) {
+  allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+  if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
     throw std::runtime_error("Failed to allocate command buffers.");
   }
-}
 
-void VulkanApp::createSyncObjects() {
   VkSemaphoreCreateInfo semaphoreInfo{};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
@@ -649,16 +1037,267 @@ void VulkanApp::createSyncObjects() {
   fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-  if (vkCreateSemaphore(context_.device(), &semaphoreInfo, nullptr, &imageAvailableSemaphore_) !=
-      VK_SUCCESS ||
-      vkCreateSemaphore(context_.device(), &semaphoreInfo, nullptr, &renderFinishedSemaphore_) !=
-          VK_SUCCESS ||
-      vkCreateFence(context_.device(), &fenceInfo, nullptr, &inFlightFence_) != VK_SUCCESS) {
-    throw std::runtime_error("Failed to create sync objects.");
+  // With timeline semaphores one counter tracks every frame's completion; fences are the
+  // fallback for drivers without the feature.
+  if (context_.timelineSemaphores()) {
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+    VkSemaphoreCreateInfo timelineInfo = semaphoreInfo;
+    timelineInfo.pNext = &typeInfo;
+    if (vkCreateSemaphore(device, &timelineInfo, nullptr, &frameTimeline_) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create timeline semaphore.");
+    }
+    timelineValue_ = 0;
+  }
+
+  std::vector<VkCommandBuffer> transferBuffers(frames_.size(), VK_NULL_HANDLE);
+  if (transferCommandPool_ != VK_NULL_HANDLE) {
+    allocInfo.commandPool = transferCommandPool_;
+    if (vkAllocateCommandBuffers(device, &allocInfo, transferBuffers.data()) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to allocate transfer command buffers.");
+    }
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+    VkSemaphoreCreateInfo timelineInfo = semaphoreInfo;
+    timelineInfo.pNext = &typeInfo;
+    if (vkCreateSemaphore(device, &timelineInfo, nullptr, &uploadTimeline_) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create upload timeline semaphore.");
+    }
+    uploadValue_ = 0;
   }
+
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    FrameResources& frame = frames_[i];
+    frame.uploadCommands = commandBuffers[i];
+    frame.transferCommands = transferBuffers[i];
+    frame.uploadValue = 0;
+    frame.timelineValue = 0;
+    if (!offscreen_ &&
+        vkCreateSemaphore(device, &semaphoreInfo, nullptr, &frame.imageAvailable) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create sync objects.");
+    }
+    if (frameTimeline_ == VK_NULL_HANDLE &&
+        vkCreateFence(device, &fenceInfo, nullptr, &frame.inFlight) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create sync objects.");
+    }
+  }
+  if (!offscreen_) {
+    createRenderFinishedSemaphores();
+  }
+  createTimestampQueries();
 }
 
-void VulkanApp::cleanupSwapchain() {
+void VulkanApp::createTimestampQueries() {
+  graphicsTimestampMask_ =
+      timestampMask(context_.timestampValidBits(context_.graphicsFamilyIndex()));
+  transferTimestampMask_ = 0;
+  if (graphicsTimestampMask_ == 0 || frames_.empty()) {
+    return;
+  }
+  // Transfer-only queues cannot record query resets, so their queries are reset from the host.
+  if (context_.dedicatedTransferQueue() && context_.hostQueryReset()) {
+    transferTimestampMask_ =
+        timestampMask(context_.timestampValidBits(context_.transferFamilyIndex()));
+  }
+  VkDevice device = context_.device();
+  VkQueryPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  poolInfo.queryCount = static_cast<uint32_t>(frames_.size()) * kQueriesPerFrame;
+  if (vkCreateQueryPool(device, &poolInfo, nullptr, &timestampPool_) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create timestamp query pool.");
+  }
+  if (transferTimestampMask_ != 0) {
+    vkResetQueryPool(device, timestampPool_, 0, poolInfo.queryCount);
+  }
+
+  std::vector<VkCommandBuffer> commandBuffers(frames_.size());
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = commandPool_;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+  if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate command buffers.");
+  }
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    FrameResources& frame = frames_[i];
+    frame.queryBase = static_cast<uint32_t>(i) * kQueriesPerFrame;
+    frame.timestampCommands = commandBuffers[i];
+    vkBeginCommandBuffer(frame.timestampCommands, &beginInfo);
+    vkCmdWriteTimestamp(frame.timestampCommands, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        timestampPool_, frame.queryBase + kQueryDrawEnd);
+    vkEndCommandBuffer(frame.timestampCommands);
+  }
+}
+
+void VulkanApp::readTimestamps(FrameResources& frame) {
+  if (!frame.graphicsTimestamps) {
+    return;
+  }
+  // The slot's submission has completed, so the results are ready without waiting.
+  VkDevice device = context_.device();
+  std::array<uint64_t, kQueriesPerFrame> ticks{};
+  const uint32_t count = frame.transferTimestamps ? kQueriesPerFrame : kQueryTransferBegin;
+  const VkResult result =
+      vkGetQueryPoolResults(device, timestampPool_, frame.queryBase, count, sizeof(ticks),
+                            ticks.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  if (result == VK_SUCCESS) {
+    const double period = context_.properties().limits.timestampPeriod;
+    const auto elapsedNs = [&](uint32_t begin, uint32_t end, uint64_t mask) {
+      return static_cast<uint64_t>(static_cast<double>((ticks[end] - ticks[begin]) & mask) *
+                                   period);
+    };
+    Profiler& profiler = Profiler::instance();
+    const uint64_t uploadNs =
+        elapsedNs(kQueryUploadBegin, kQueryUploadEnd, graphicsTimestampMask_);
+    profiler.record(ProfileStage::GpuUpload, frame.submitNs, uploadNs);
+    profiler.record(ProfileStage::GpuDraw, frame.submitNs + uploadNs,
+                    elapsedNs(kQueryUploadEnd, kQueryDrawEnd, graphicsTimestampMask_));
+    if (frame.transferTimestamps) {
+      profiler.record(ProfileStage::GpuTransfer, frame.submitNs,
+                      elapsedNs(kQueryTransferBegin, kQueryTransferEnd, transferTimestampMask_));
+    }
+  }
+  if (frame.transferTimestamps) {
+    vkResetQueryPool(device, timestampPool_, frame.queryBase + kQueryTransferBegin, 2);
+  }
+  frame.graphicsTimestamps = false;
+  frame.transferTimestamps = false;
+}
+
+void VulkanApp::createRenderFinishedSemaphores() {
+  VkDevice device = context_.device();
+  for (auto semaphore : renderFinishedSemaphores_) {
+    vkDestroySemaphore(device, semaphore, nullptr);
+  }
+  renderFinishedSemaphores_.assign(swapchainImages_.size(), VK_NULL_HANDLE);
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  for (auto& semaphore : renderFinishedSemaphores_) {
+    if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create sync objects.");
+    }
+  }
+}
+
+void VulkanApp::destroyFrameResources() {
+  VkDevice device = context_.device();
+  for (auto& frame : frames_) {
+    if (frame.imageAvailable != VK_NULL_HANDLE) {
+      vkDestroySemaphore(device, frame.imageAvailable, nullptr);
+    }
+    if (frame.inFlight != VK_NULL_HANDLE) {
+      vkDestroyFence(device, frame.inFlight, nullptr);
+    }
+  }
+  frames_.clear();
+  for (auto semaphore : renderFinishedSemaphores_) {
+    vkDestroySemaphore(device, semaphore, nullptr);
+  }
+  renderFinishedSemaphores_.clear();
+  if (frameTimeline_ != VK_NULL_HANDLE) {
+    vkDestroySemaphore(device, frameTimeline_, nullptr);
+    frameTimeline_ = VK_NULL_HANDLE;
+  }
+  if (uploadTimeline_ != VK_NULL_HANDLE) {
+    vkDestroySemaphore(device, uploadTimeline_, nullptr);
+    uploadTimeline_ = VK_NULL_HANDLE;
+  }
+  if (timestampPool_ != VK_NULL_HANDLE) {
+    vkDestroyQueryPool(device, timestampPool_, nullptr);
+    timestampPool_ = VK_NULL_HANDLE;
+  }
+}
+
+void VulkanApp::createDrawTargets() {
+  destroyDrawTargets();
+  VkDevice device = context_.device();
+  const size_t count = offscreen_ ? frames_.size() : swapchainImages_.size();
+  drawTargets_.resize(count);
+
+  std::vector<VkCommandBuffer> commandBuffers(count + (offscreen_ ? 1 : 0));
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = commandPool_;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+  if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate command buffers.");
+  }
+  for (size_t i = 0; i < count; ++i) {
+    drawTargets_[i].drawCommands = commandBuffers[i];
+  }
+  if (offscreen_) {
+    readbackCommands_ = commandBuffers.back();
+    // Only reads the fixed offscreen image into the fixed readback buffer, so it never needs
+    // re-recording.
+    if (readbackBuffer_.buffer != VK_NULL_HANDLE) {
+      VkCommandBufferBeginInfo beginInfo{};
+      beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      vkBeginCommandBuffer(readbackCommands_, &beginInfo);
+      recordReadback(readbackCommands_);
+      vkEndCommandBuffer(readbackCommands_);
+    }
+  }
+
+  const VkDeviceSize alignment = std::max<VkDeviceSize>(
+      1, context_.properties().limits.minUniformBufferOffsetAlignment);
+  frameDataStride_ = (sizeof(FrameData) + alignment - 1) / alignment * alignment;
+  frameDataBuffer_ = context_.createBuffer(frameDataStride_ * count,
+                                           VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                           AllocationStrategy::Pool);
+  // The projection only depends on the extent, so it is computed here rather than per frame.
+  updateMVP();
+  createDescriptorPool();
+  createDescriptorSets();
+  // The new targets start out behind, so each is recorded before its first use.
+  ++drawGeneration_;
+}
+
+void VulkanApp::destroyDrawTargets() {
+  std::vector<VkCommandBuffer> commandBuffers;
+  for (const auto& target : drawTargets_) {
+    commandBuffers.push_back(target.drawCommands);
+  }
+  if (readbackCommands_ != VK_NULL_HANDLE) {
+    commandBuffers.push_back(readbackCommands_);
+    readbackCommands_ = VK_NULL_HANDLE;
+  }
+  if (!commandBuffers.empty()) {
+    vkFreeCommandBuffers(context_.device(), commandPool_,
+                         static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+  }
+  // Descriptor sets go back with the pool in cleanupSwapchain().
+  drawTargets_.clear();
+  context_.destroyBuffer(frameDataBuffer_);
+  frameDataStride_ = 0;
+}
+
+void VulkanApp::recordDrawTarget(size_t targetIndex) {
+  waitForPipeline();
+  DrawTarget& target = drawTargets_[targetIndex];
+  if (target.generation != drawGeneration_ && target.descriptorSet != VK_NULL_HANDLE) {
+    writeDescriptorSet(targetIndex);
+  }
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  vkBeginCommandBuffer(target.drawCommands, &beginInfo);
+  recordRenderPass(target.drawCommands, offscreen_ ? 0 : static_cast<uint32_t>(targetIndex),
+                   target.descriptorSet);
+  vkEndCommandBuffer(target.drawCommands);
+  target.generation = drawGeneration_;
+}
+
+void VulkanApp::destroySwapchainImages() {
   if (depthImageView_ != VK_NULL_HANDLE) {
     vkDestroyImageView(context_.device(), depthImageView_, nullptr);
     depthImageView_ = VK_NULL_HANDLE;
@@ -677,27 +1316,39 @@ void VulkanApp::cleanupSwapchain() {
     vkDestroyFramebuffer(device, framebuffer, nullptr);
   }
   swapchainFramebuffers_.clear();
-  if (graphicsPipeline_ != VK_NULL_HANDLE) {
-    vkDestroyPipeline(device, graphicsPipeline_, nullptr);
-    graphicsPipeline_ = VK_NULL_HANDLE;
+  for (auto imageView : swapchainImageViews_) {
+    vkDestroyImageView(device, imageView, nullptr);
   }
-  if (pipelineLayout_ != VK_NULL_HANDLE) {
-    vkDestroyPipelineLayout(device, pipelineLayout_, nullptr);
-    pipelineLayout_ = VK_NULL_HANDLE;
+  swapchainImageViews_.clear();
+}
+
+void VulkanApp::destroyRenderPass() {
+  VkDevice device = context_.device();
+  // A build still compiling against renderPass_ has to finish before the pass goes away.
+  waitForPipeline();
+  for (auto& pipeline : graphicsPipelines_) {
+    if (pipeline != VK_NULL_HANDLE) {
+      vkDestroyPipeline(device, pipeline, nullptr);
+      pipeline = VK_NULL_HANDLE;
+    }
   }
   if (renderPass_ != VK_NULL_HANDLE) {
     vkDestroyRenderPass(device, renderPass_, nullptr);
     renderPass_ = VK_NULL_HANDLE;
   }
+}
+
+void VulkanApp::cleanupSwapchain() {
+  destroySwapchainImages();
+  destroyRenderPass();
+  VkDevice device = context_.device();
   if (descriptorPool_ != VK_NULL_HANDLE) {
     vkDestroyDescriptorPool(device, descriptorPool_, nullptr);
     descriptorPool_ = VK_NULL_HANDLE;
-    descriptorSet_ = VK_NULL_HANDLE;
-  }
-  for (auto imageView : swapchainImageViews_) {
-    vkDestroyImageView(device, imageView, nullptr);
+    for (auto& target : drawTargets_) {
+      target.descriptorSet = VK_NULL_HANDLE;
+    }
   }
-  swapchainImageViews_.clear();
   if (swapchain_ != VK_NULL_HANDLE) {
     vkDestroySwapchainKHR(device, swapchain_, nullptr);
     swapchain_ = VK_NULL_HANDLE;
@@ -712,18 +1363,33 @@ void VulkanApp::recreateSwapchain() {
     return;
   }
   vkDeviceWaitIdle(context_.device());
-  cleanupSwapchain();
+  const VkFormat previousFormat = swapchainImageFormat_;
+  const size_t previousImageCount = swapchainImages_.size();
+  destroySwapchainImages();
   createSwapchain();
   createImageViews();
   createDepthResources();
-  createRenderPass();
-  if (waterfallBuffer_.buffer != VK_NULL_HANDLE && analysisBuffer_.buffer != VK_NULL_HANDLE) {
-    createDescriptorPool();
-    createDescriptorSet();
+  // The pipeline only depends on the render pass, which only depends on the formats.
+  if (swapchainImageFormat_ != previousFormat) {
+    destroyRenderPass();
+    createRenderPass();
+    createPipeline();
   }
-  createPipeline();
   createFramebuffers();
-  createCommandBuffers();
+  if (swapchainImages_.size() != previousImageCount) {
+    // Draw targets, their descriptor sets and frame data slices are per swapchain image.
+    if (descriptorPool_ != VK_NULL_HANDLE) {
+      vkDestroyDescriptorPool(context_.device(), descriptorPool_, nullptr);
+      descriptorPool_ = VK_NULL_HANDLE;
+    }
+    createRenderFinishedSemaphores();
+    createDrawTargets();
+  } else {
+    // Same targets and descriptor sets; only the extent and framebuffers baked into the
+    // pre-recorded draws changed.
+    updateMVP();
+    ++drawGeneration_;
+  }
 }
 
 void VulkanApp::updateMVP() {
@@ -752,30 +1418,315 @@ void VulkanApp::updateMVP() {
 }
 
 void VulkanApp::drawFrame() {
-  vkWaitForFences(context_.device(), 1, &inFlightFence_, VK_TRUE, UINT64_MAX);
-  vkResetFences(context_.device(), 1, &inFlightFence_);
+  FrameResources& frame = frames_[currentFrame_];
+  {
+    UVK_PROFILE_SCOPE(Wait);
+    waitForFrame(frame);
+  }
+  readTimestamps(frame);
+  releaseRetired();
 
   uint32_t imageIndex = 0;
-  VkResult result = vkAcquireNextImageKHR(context_.device(), swapchain_, UINT64_MAX,
-                                          imageAvailableSemaphore_, VK_NULL_HANDLE, &imageIndex);
+  VkResult result = VK_SUCCESS;
+  {
+    UVK_PROFILE_SCOPE(Wait);
+    result = vkAcquireNextImageKHR(context_.device(), swapchain_, UINT64_MAX,
+                                   frame.imageAvailable, VK_NULL_HANDLE, &imageIndex);
+  }
   if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    // Nothing was submitted for this slot, so its fence is still signalled for next time.
     recreateSwapchain();
     return;
   }
 
-  VkCommandBuffer commandBuffer = commandBuffers_[imageIndex];
-  vkResetCommandBuffer(commandBuffer, 0);
+  DrawTarget& target = drawTargets_[imageIndex];
+  {
+    UVK_PROFILE_SCOPE(Wait);
+    waitForTarget(target);
+  }
+  {
+    UVK_PROFILE_SCOPE(CommandRecording);
+    // Only this target's own last submission has to complete before it is re-recorded.
+    if (target.generation != drawGeneration_) {
+      recordDrawTarget(imageIndex);
+    }
+    writeFrameData(imageIndex);
+    recordUploads(frame);
+  }
+
+  VkSemaphore renderFinished = renderFinishedSemaphores_[imageIndex];
+  {
+    UVK_PROFILE_SCOPE(Submit);
+    submitUploads(frame);
+    submitFrame(frame, target, false, frame.imageAvailable, renderFinished);
+  }
+  traceCounters();
+  currentFrame_ = (currentFrame_ + 1) % frames_.size();
+
+  VkPresentInfoKHR presentInfo{};
+  presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+  presentInfo.waitSemaphoreCount = 1;
+  presentInfo.pWaitSemaphores = &renderFinished;
+  VkSwapchainKHR swapchains[] = {swapchain_};
+  presentInfo.swapchainCount = 1;
+  presentInfo.pSwapchains = swapchains;
+  presentInfo.pImageIndices = &imageIndex;
 
+  {
+    UVK_PROFILE_SCOPE(Present);
+    result = vkQueuePresentKHR(context_.presentQueue(), &presentInfo);
+  }
+  if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+    recreateSwapchain();
+  }
+}
+
+void VulkanApp::waitForFrame(const FrameResources& frame) {
+  if (frameTimeline_ != VK_NULL_HANDLE) {
+    if (frame.timelineValue == 0) {
+      return;
+    }
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &frameTimeline_;
+    waitInfo.pValues = &frame.timelineValue;
+    vkWaitSemaphores(context_.device(), &waitInfo, UINT64_MAX);
+  } else {
+    vkWaitForFences(context_.device(), 1, &frame.inFlight, VK_TRUE, UINT64_MAX);
+  }
+  // Signals cover everything submitted earlier on the queue too.
+  completedValue_ = std::max(completedValue_, frame.timelineValue);
+}
+
+void VulkanApp::waitForTarget(const DrawTarget& target) {
+  // A swapchain image can come back before the frame that last drew it has finished, and
+  // its draw commands and frame data must not be touched while still pending.
+  if (frameTimeline_ != VK_NULL_HANDLE) {
+    if (target.lastTimelineValue == 0) {
+      return;
+    }
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &frameTimeline_;
+    waitInfo.pValues = &target.lastTimelineValue;
+    vkWaitSemaphores(context_.device(), &waitInfo, UINT64_MAX);
+    completedValue_ = std::max(completedValue_, target.lastTimelineValue);
+  } else if (target.lastFence != VK_NULL_HANDLE) {
+    vkWaitForFences(context_.device(), 1, &target.lastFence, VK_TRUE, UINT64_MAX);
+  }
+}
+
+void VulkanApp::writeFrameData(size_t targetIndex) {
+  if (!frameDataBuffer_.mapped) {
+    return;
+  }
+  FrameData data{};
+  std::memcpy(data.projection, mvp_.projection, sizeof(data.projection));
+  std::memcpy(data.metrics, analysisMetrics_.data(), sizeof(data.metrics));
+  data.layout[0] = static_cast<float>(waterfallLayout_.binCount);
+  data.layout[1] = static_cast<float>(waterfallLayout_.rowCount());
+  data.layout[2] = static_cast<float>(waterfallLayout_.rowsPerTier);
+  data.layout[3] = static_cast<float>(waterfallLayout_.tierCount);
+  data.encoding[0] = static_cast<float>(waterfallLayout_.encoding.format);
+  data.encoding[1] = waterfallLayout_.encoding.minDb;
+  data.encoding[2] = waterfallLayout_.encoding.maxDb;
+  data.encoding[3] = static_cast<float>(waterfallCopy_ * waterfallLayout_.copyWords());
+  for (size_t tier = 0; tier < kMaxWaterfallTiers; ++tier) {
+    data.tierHeads[tier] = static_cast<float>(waterfallHeads_[tier]);
+  }
+  auto* mapped = static_cast<unsigned char*>(frameDataBuffer_.mapped);
+  std::memcpy(mapped + frameDataStride_ * targetIndex, &data, sizeof(data));
+  context_.flushBuffer(frameDataBuffer_);
+}
+
+void VulkanApp::recordUploads(FrameResources& frame) {
   VkCommandBufferBeginInfo beginInfo{};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  vkBeginCommandBuffer(commandBuffer, &beginInfo);
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  UploadCommands commands;
+  commands.graphics = frame.uploadCommands;
+  commands.graphicsFamily = context_.graphicsFamilyIndex();
+  commands.transfer = commands.graphics;
+  commands.transferFamily = commands.graphicsFamily;
+  frame.graphicsTimestamps = timestampPool_ != VK_NULL_HANDLE && Profiler::instance().enabled();
+  frame.transferTimestamps = frame.graphicsTimestamps && transferTimestampMask_ != 0 &&
+                             frame.transferCommands != VK_NULL_HANDLE;
+  if (frame.transferCommands != VK_NULL_HANDLE) {
+    commands.transfer = frame.transferCommands;
+    commands.transferFamily = context_.transferFamilyIndex();
+    vkResetCommandBuffer(commands.transfer, 0);
+    vkBeginCommandBuffer(commands.transfer, &beginInfo);
+    if (frame.transferTimestamps) {
+      vkCmdWriteTimestamp(commands.transfer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool_,
+                          frame.queryBase + kQueryTransferBegin);
+    }
+  }
+  vkResetCommandBuffer(commands.graphics, 0);
+  vkBeginCommandBuffer(commands.graphics, &beginInfo);
+  if (frame.graphicsTimestamps) {
+    vkCmdResetQueryPool(commands.graphics, timestampPool_, frame.queryBase, kQueryTransferBegin);
+    vkCmdWriteTimestamp(commands.graphics, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool_,
+                        frame.queryBase + kQueryUploadBegin);
+  }
+  if (meshIndexStaging_.buffer != VK_NULL_HANDLE) {
+    recordIndexUpload(commands.graphics);
+  }
+  frame.transferRecorded = transferRecorder_ && transferRecorder_(commands);
+  if (!frame.transferRecorded) {
+    // Nothing to wait for or time on the transfer queue this frame.
+    frame.transferTimestamps = false;
+  }
+  if (frame.graphicsTimestamps) {
+    vkCmdWriteTimestamp(commands.graphics, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool_,
+                        frame.queryBase + kQueryUploadEnd);
+  }
+  vkEndCommandBuffer(commands.graphics);
+  if (frame.transferCommands != VK_NULL_HANDLE) {
+    if (frame.transferTimestamps) {
+      vkCmdWriteTimestamp(commands.transfer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                          timestampPool_, frame.queryBase + kQueryTransferEnd);
+    }
+    vkEndCommandBuffer(commands.transfer);
+  }
+}
 
-  updateMVP();
+void VulkanApp::recordIndexUpload(VkCommandBuffer commandBuffer) {
+  // The index buffer of a freshly switched source is only filled now, so nothing has read it
+  // yet; the barrier orders the copy before this and every later frame's index fetch.
+  VkBufferCopy region{};
+  region.size = meshIndexBuffer_.size;
+  vkCmdCopyBuffer(commandBuffer, meshIndexStaging_.buffer, meshIndexBuffer_.buffer, 1, &region);
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDEX_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = meshIndexBuffer_.buffer;
+  barrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &barrier, 0,
+                       nullptr);
+  // The copy belongs to the submission about to be made.
+  retired_.push_back({timelineValue_ + 1, [this, staging = meshIndexStaging_]() mutable {
+                        context_.destroyBuffer(staging);
+                      }});
+  meshIndexStaging_ = {};
+}
 
+void VulkanApp::submitUploads(FrameResources& frame) {
+  frame.uploadValue = 0;
+  if (frame.transferCommands == VK_NULL_HANDLE || !frame.transferRecorded) {
+    return;
+  }
+  // The history copy being written was last drawn from `copies` frames back, so the copies
+  // only wait for that frame (and anything before it); the draw of this frame then waits for
+  // the copies. With one copy that is the previous frame, i.e. everything submitted so far.
+  const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  const uint64_t waitValue =
+      timelineValue_ - std::min<uint64_t>(timelineValue_, waterfallLayout_.copies - 1);
+  frame.uploadValue = ++uploadValue_;
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.waitSemaphoreValueCount = waitValue != 0 ? 1 : 0;
+  timelineInfo.pWaitSemaphoreValues = &waitValue;
+  timelineInfo.signalSemaphoreValueCount = 1;
+  timelineInfo.pSignalSemaphoreValues = &frame.uploadValue;
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.pNext = &timelineInfo;
+  submitInfo.waitSemaphoreCount = timelineInfo.waitSemaphoreValueCount;
+  submitInfo.pWaitSemaphores = &frameTimeline_;
+  submitInfo.pWaitDstStageMask = &waitStage;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &frame.transferCommands;
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = &uploadTimeline_;
+  if (vkQueueSubmit(context_.transferQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to submit upload command buffer.");
+  }
+}
+
+void VulkanApp::submitFrame(FrameResources& frame, DrawTarget& target, bool readback,
+                            VkSemaphore waitSemaphore, VkSemaphore signalSemaphore) {
+  // Barriers in the upload commands also order the pre-recorded draw that follows them.
+  VkCommandBuffer commandBuffers[4] = {frame.uploadCommands, target.drawCommands};
+  uint32_t commandBufferCount = 2;
+  if (readback && readbackCommands_ != VK_NULL_HANDLE &&
+      readbackBuffer_.buffer != VK_NULL_HANDLE) {
+    commandBuffers[commandBufferCount++] = readbackCommands_;
+  }
+  if (frame.graphicsTimestamps) {
+    commandBuffers[commandBufferCount++] = frame.timestampCommands;
+    frame.submitNs = Profiler::now();
+  }
+
+  VkSemaphore waitSemaphores[2]{};
+  VkPipelineStageFlags waitStages[2]{};
+  uint64_t waitValues[2]{};
+  uint32_t waitCount = 0;
+  if (waitSemaphore != VK_NULL_HANDLE) {
+    waitStages[waitCount] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    waitSemaphores[waitCount++] = waitSemaphore;
+  }
+  if (frame.uploadValue != 0) {
+    // The acquire barriers at the start of the upload commands only need to wait before the
+    // vertex shader reads the uploaded rows.
+    waitStages[waitCount] = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+    waitValues[waitCount] = frame.uploadValue;
+    waitSemaphores[waitCount++] = uploadTimeline_;
+  }
+  VkSemaphore signalSemaphores[2]{};
+  uint64_t signalValues[2]{};
+  uint32_t signalCount = 0;
+  if (signalSemaphore != VK_NULL_HANDLE) {
+    signalSemaphores[signalCount++] = signalSemaphore;
+  }
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.waitSemaphoreCount = waitCount;
+  submitInfo.pWaitSemaphores = waitCount > 0 ? waitSemaphores : nullptr;
+  submitInfo.pWaitDstStageMask = waitCount > 0 ? waitStages : nullptr;
+  submitInfo.commandBufferCount = commandBufferCount;
+  submitInfo.pCommandBuffers = commandBuffers;
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  frame.timelineValue = ++timelineValue_;
+  if (frameTimeline_ != VK_NULL_HANDLE) {
+    signalValues[signalCount] = frame.timelineValue;
+    signalSemaphores[signalCount++] = frameTimeline_;
+    // Binary semaphores ignore their entries in the value arrays.
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = waitCount;
+    timelineInfo.pWaitSemaphoreValues = waitValues;
+    timelineInfo.signalSemaphoreValueCount = signalCount;
+    timelineInfo.pSignalSemaphoreValues = signalValues;
+    submitInfo.pNext = &timelineInfo;
+  } else {
+    vkResetFences(context_.device(), 1, &frame.inFlight);
+  }
+  submitInfo.signalSemaphoreCount = signalCount;
+  submitInfo.pSignalSemaphores = signalCount > 0 ? signalSemaphores : nullptr;
+
+  // frame.inFlight is null when the timeline semaphore tracks completion.
+  if (vkQueueSubmit(context_.graphicsQueue(), 1, &submitInfo, frame.inFlight) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to submit draw command buffer.");
+  }
+  target.lastFence = frame.inFlight;
+  target.lastTimelineValue = frame.timelineValue;
+}
+
+void VulkanApp::recordRenderPass(VkCommandBuffer commandBuffer, uint32_t framebufferIndex,
+                                 VkDescriptorSet descriptorSet) {
   VkRenderPassBeginInfo renderPassInfo{};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   renderPassInfo.renderPass = renderPass_;
-  renderPassInfo.framebuffer = swapchainFramebuffers_[imageIndex];
+  renderPassInfo.framebuffer = swapchainFramebuffers_[framebufferIndex];
   renderPassInfo.renderArea.offset = {0, 0};
   renderPassInfo.renderArea.extent = swapchainExtent_;
   VkClearValue clearValues[2]{};
@@ -786,91 +1737,196 @@ void VulkanApp::drawFrame() {
   renderPassInfo.pClearValues = clearValues;
 
   vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline_);
-  if (descriptorSet_ != VK_NULL_HANDLE) {
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 0, 1,
-                            &descriptorSet_, 0, nullptr);
-  }
-
-  struct PushConstants {
-    float projection[16];
-    float binCount;
-    float historyLength;
-    float padding[2];
-  } push;
-
-  std::memcpy(push.projection, mvp_.projection, sizeof(float) * 16);
-  push.binCount = static_cast<float>(waterfallBinCount_);
-  push.historyLength = static_cast<float>(waterfallHistoryLength_);
-
-  vkCmdPushConstants(commandBuffer, pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0,
-                     sizeof(push), &push);
-
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    graphicsPipelines_[static_cast<size_t>(drawMode_)]);
+  VkViewport viewport{};
+  viewport.width = static_cast<float>(swapchainExtent_.width);
+  viewport.height = static_cast<float>(swapchainExtent_.height);
+  viewport.minDepth = 0.0f;
+  viewport.maxDepth = 1.0f;
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  VkRect2D scissor{};
+  scissor.extent = swapchainExtent_;
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+  // Without a descriptor set there is no waterfall to read; the pass then only clears.
   const uint32_t vertexCount =
-      static_cast<uint32_t>(waterfallBinCount_ * waterfallHistoryLength_);
-  if (vertexCount > 0) {
-    vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+      static_cast<uint32_t>(waterfallLayout_.binCount * waterfallLayout_.rowCount());
+  if (descriptorSet != VK_NULL_HANDLE && vertexCount > 0) {
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 0, 1,
+                            &descriptorSet, 0, nullptr);
+    if (drawMode_ == WaterfallDrawMode::Surface && meshIndexCount_ > 0) {
+      vkCmdBindIndexBuffer(commandBuffer, meshIndexBuffer_.buffer, 0, meshIndexType_);
+      vkCmdDrawIndexed(commandBuffer, meshIndexCount_, 1, 0, 0, 0);
+    } else {
+      vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+    }
   }
   vkCmdEndRenderPass(commandBuffer);
+}
 
-  vkEndCommandBuffer(commandBuffer);
-
-  VkSemaphore waitSemaphores[] = {imageAvailableSemaphore_};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  VkSemaphore signalSemaphores[] = {renderFinishedSemaphore_};
-
-  VkSubmitInfo submitInfo{};
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = waitSemaphores;
-  submitInfo.pWaitDstStageMask = waitStages;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &commandBuffer;
-  submitInfo.signalSemaphoreCount = 1;
-  submitInfo.pSignalSemaphores = signalSemaphores;
+void VulkanApp::recordReadback(VkCommandBuffer commandBuffer) {
+  // The render pass already left the image in TRANSFER_SRC_OPTIMAL; only the
+  // attachment writes need to be made visible to the copy.
+  VkImageMemoryBarrier toTransfer{};
+  toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  toTransfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  toTransfer.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  toTransfer.image = offscreenImage_;
+  toTransfer.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  toTransfer.subresourceRange.levelCount = 1;
+  toTransfer.subresourceRange.layerCount = 1;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                       &toTransfer);
+
+  VkBufferImageCopy region{};
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.layerCount = 1;
+  region.imageExtent = {swapchainExtent_.width, swapchainExtent_.height, 1};
+  vkCmdCopyImageToBuffer(commandBuffer, offscreenImage_, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         readbackBuffer_.buffer, 1, &region);
+
+  VkBufferMemoryBarrier toHost{};
+  toHost.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  toHost.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  toHost.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  toHost.buffer = readbackBuffer_.buffer;
+  toHost.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &toHost, 0, nullptr);
+}
 
-  if (vkQueueSubmit(context_.graphicsQueue(), 1, &submitInfo, inFlightFence_) != VK_SUCCESS) {
-    throw std::runtime_error("Failed to submit draw command buffer.");
+void VulkanApp::drawOffscreenFrame(bool readback) {
+  // Offscreen there is a single color image, so draw targets map one-to-one to frame slots.
+  const size_t targetIndex = currentFrame_;
+  FrameResources& frame = frames_[currentFrame_];
+  {
+    UVK_PROFILE_SCOPE(Wait);
+    waitForFrame(frame);
+  }
+  readTimestamps(frame);
+  releaseRetired();
+  {
+    UVK_PROFILE_SCOPE(CommandRecording);
+    // waitForFrame() above covered this target's last submission.
+    if (drawTargets_[targetIndex].generation != drawGeneration_) {
+      recordDrawTarget(targetIndex);
+    }
+    writeFrameData(targetIndex);
+    recordUploads(frame);
   }
+  {
+    UVK_PROFILE_SCOPE(Submit);
+    submitUploads(frame);
+    submitFrame(frame, drawTargets_[targetIndex], readback, VK_NULL_HANDLE, VK_NULL_HANDLE);
+  }
+  traceCounters();
+  currentFrame_ = (currentFrame_ + 1) % frames_.size();
+}
 
-  VkPresentInfoKHR presentInfo{};
-  presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-  presentInfo.waitSemaphoreCount = 1;
-  presentInfo.pWaitSemaphores = signalSemaphores;
-  VkSwapchainKHR swapchains[] = {swapchain_};
-  presentInfo.swapchainCount = 1;
-  presentInfo.pSwapchains = swapchains;
-  presentInfo.pImageIndices = &imageIndex;
+void VulkanApp::runOffscreen(const std::function<void()>& perFrame) {
+  using Clock = std::chrono::steady_clock;
+  const size_t frameCount = offscreenOptions_.frameCount;
+  // Frame times go through the profiler like every other timing, so --profile and this
+  // summary agree. Without --profile it is enabled just for the run, over every frame.
+  Profiler& profiler = Profiler::instance();
+  const bool ownProfiler = !profiler.enabled();
+  if (ownProfiler) {
+    ProfilerOptions options;
+    options.windowFrames = frameCount;
+    profiler.enable(options);
+  }
 
-  result = vkQueuePresentKHR(context_.presentQueue(), &presentInfo);
-  if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
-    recreateSwapchain();
+  const auto runStart = Clock::now();
+  // Starts the first frame's interval.
+  profiler.endFrame();
+  for (size_t frame = 0; frame < frameCount; ++frame) {
+    if (perFrame) {
+      perFrame();
+    }
+    drawOffscreenFrame(frame + 1 == frameCount && !offscreenOptions_.readbackPath.empty());
+    profiler.endFrame();
+  }
+  vkDeviceWaitIdle(context_.device());
+  // With several frames in flight, per-frame times only include waiting for older frames; the
+  // total up to device idle is the real throughput.
+  const double totalSeconds = std::chrono::duration<double>(Clock::now() - runStart).count();
+
+  std::cout << "Offscreen: " << frameCount << " frames at " << swapchainExtent_.width << "x"
+            << swapchainExtent_.height << ", " << frames_.size() << " in flight, "
+            << totalSeconds << " s ("
+            << (totalSeconds > 0.0 ? static_cast<double>(frameCount) / totalSeconds : 0.0)
+            << " fps)\n";
+  reportStage("Frame", ProfileStage::Frame);
+  // Timestamps are read back as frame slots are reused, so the last frames in flight are not
+  // included.
+  reportStage("GPU draw", ProfileStage::GpuDraw);
+  if (ownProfiler) {
+    profiler.disable();
+  }
+  const auto memory = context_.memoryStats();
+  std::cout << "GPU memory: " << memory.bytesAllocated / 1024 << " KiB in "
+            << memory.allocationCount << " allocations across " << memory.blocksInUse
+            << " blocks (" << memory.bytesReserved / 1024 << " KiB reserved, "
+            << memory.bytesWasted / 1024 << " KiB wasted)\n";
+  if (frameCount > 0 && !offscreenOptions_.readbackPath.empty()) {
+    writeReadback(offscreenOptions_.readbackPath);
   }
 }
 
-std::vector<char> VulkanApp::readFile(const std::string& path) {
-  std::ifstream file(path, std::ios::ate | std::ios::binary);
-  if (!file) {
-    throw std::runtime_error("Failed to open shader file: " + path);
+void VulkanApp::updateProfileOverlay() {
+  // Retitling every frame would cost more than the stages it reports.
+  constexpr size_t kOverlayIntervalFrames = 30;
+  if (!profileOverlay_ || !Profiler::instance().enabled() ||
+      ++overlayFrame_ % kOverlayIntervalFrames != 0) {
+    return;
   }
-  const size_t fileSize = static_cast<size_t>(file.tellg());
-  std::vector<char> buffer(fileSize);
-  file.seekg(0);
-  file.read(buffer.data(), static_cast<std::streamsize>(fileSize));
-  return buffer;
+  const std::string title = title_ + " | " + Profiler::instance().overlayText();
+  glfwSetWindowTitle(window_, title.c_str());
 }
 
-VkShaderModule VulkanApp::createShaderModule(const std::vector<char>& code) {
-  VkShaderModuleCreateInfo createInfo{};
-  createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  createInfo.codeSize = code.size();
-  createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+void VulkanApp::traceCounters() {
+#if defined(UVK_ENABLE_PROFILER)
+  Profiler& profiler = Profiler::instance();
+  if (!profiler.tracing()) {
+    return;
+  }
+  profiler.recordCounter(ProfileCounter::FramesInFlight,
+                         static_cast<int64_t>(timelineValue_ - completedValue_));
+  profiler.recordCounter(ProfileCounter::RetiredResources, static_cast<int64_t>(retired_.size()));
+  const auto memory = context_.memoryStats();
+  profiler.recordCounter(ProfileCounter::GpuAllocations,
+                         static_cast<int64_t>(memory.allocationCount));
+  profiler.recordCounter(ProfileCounter::GpuAllocatedKiB,
+                         static_cast<int64_t>(memory.bytesAllocated / 1024));
+#endif
+}
 
-  VkShaderModule shaderModule = VK_NULL_HANDLE;
-  if (vkCreateShaderModule(context_.device(), &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-    throw std::runtime_error("Failed to create shader module.");
+void VulkanApp::writeReadback(const std::string& path) {
+  if (readbackBuffer_.buffer == VK_NULL_HANDLE) {
+    return;
+  }
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Failed to open readback file: " + path);
+  }
+  context_.invalidateBuffer(readbackBuffer_);
+  const auto* pixels = static_cast<const unsigned char*>(readbackBuffer_.mapped);
+  const size_t pixelCount = static_cast<size_t>(swapchainExtent_.width) * swapchainExtent_.height;
+  std::vector<char> rgb(pixelCount * 3);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    rgb[i * 3 + 0] = static_cast<char>(pixels[i * 4 + 0]);
+    rgb[i * 3 + 1] = static_cast<char>(pixels[i * 4 + 1]);
+    rgb[i * 3 + 2] = static_cast<char>(pixels[i * 4 + 2]);
   }
-  return shaderModule;
+  file << "P6\n" << swapchainExtent_.width << ' ' << swapchainExtent_.height << "\n255\n";
+  file.write(rgb.data(), static_cast<std::streamsize>(rgb.size()));
 }
 
 }  // namespace uvk
@@ -1,15 +1,50 @@
 #pragma once
 
+#include "pipeline_cache.h"
 #include "vulkan_context.h"
+#include "waterfall_format.h"
 
 #include <GLFW/glfw3.h>
 
+#include <array>
 #include <functional>
+#include <future>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace uvk {
 
+struct OffscreenOptions {
+  uint32_t width{1280};
+  uint32_t height{720};
+  size_t frameCount{600};
+  // When set, the final frame is copied back to the host and written as a binary PPM.
+  std::string readbackPath;
+};
+
+enum class WaterfallDrawMode {
+  // One point per bin and history row.
+  Points,
+  // Indexed triangle strips, with older history rows drawn at coarser bin and row resolution.
+  Surface,
+};
+
+inline constexpr size_t kWaterfallDrawModeCount = 2;
+
+// Everything the renderer needs to draw a new waterfall, built by
+// VulkanApp::prepareWaterfallSource() without touching resources in flight.
+struct PreparedWaterfallSource {
+  VulkanBuffer waterfall{};
+  WaterfallLayout layout{};
+  // Surface indices in host-visible memory and their device-local home; the copy is recorded
+  // into the first frame that draws from this source.
+  VulkanBuffer indexStaging{};
+  VulkanBuffer indices{};
+  uint32_t indexCount{0};
+  VkIndexType indexType{VK_INDEX_TYPE_UINT32};
+};
+
 class VulkanApp {
  public:
   VulkanApp() = default;
@@ -19,31 +54,177 @@ class VulkanApp {
   VulkanApp& operator=(const VulkanApp&) = delete;
 
   void initialize(const std::string& title, int width, int height);
-  void setWaterfallSource(const VulkanBuffer& buffer, size_t binCount, size_t historyLength);
-  void setAnalysisSource(const VulkanBuffer& buffer);
+  // Renders into a device image without GLFW, a surface or a swapchain (e.g. on lavapipe).
+  void initializeOffscreen(const std::string& title, const OffscreenOptions& options);
+  // Must be called before initialize(); clamped to [1, kMaxFramesInFlight].
+  void setFramesInFlight(size_t count);
+  // Must be called before initialize(); an empty path keeps the pipeline cache in memory only.
+  void setPipelineCachePath(std::string path) { pipelineCachePath_ = std::move(path); }
+  void setWaterfallSource(const VulkanBuffer& buffer, const WaterfallLayout& layout);
+  // Builds the surface mesh for `layout` and allocates its buffers. Only allocates, so it may
+  // run on a worker thread while frames keep rendering.
+  [[nodiscard]] PreparedWaterfallSource prepareWaterfallSource(const VulkanBuffer& buffer,
+                                                               const WaterfallLayout& layout);
+  // Draws from `source` from the next frame on, without idling the device: each draw target
+  // is re-pointed once its last submission has completed, and `retire` runs (after the old
+  // mesh is destroyed) once no submitted frame can still read the previous source.
+  void switchWaterfallSource(PreparedWaterfallSource source, std::function<void()> retire);
+  // Copied into the next frame's own uniform buffer, so frames still on the GPU keep theirs.
+  void setAnalysisMetrics(const std::array<float, 4>& metrics) { analysisMetrics_ = metrics; }
+  // Head row of each history tier's ring, as reported by WaterfallRenderer::tierHeads().
+  void setWaterfallHeads(const std::array<size_t, kMaxWaterfallTiers>& heads) {
+    waterfallHeads_ = heads;
+  }
+  // History copy the next frame draws from, as reported by WaterfallRenderer::historyCopy().
+  void setWaterfallCopy(size_t copy) { waterfallCopy_ = copy; }
+  void setDrawMode(WaterfallDrawMode mode);
+  // Called with the GLFW key code of each key press; windowed mode only. F3 is taken by the
+  // profiler overlay.
+  void setKeyHandler(std::function<void(int)> handler) { keyHandler_ = std::move(handler); }
+  // Called each frame before the render pass begins, so buffer uploads can be recorded ahead of
+  // the draw. Copies recorded into UploadCommands::transfer run on the transfer queue when the
+  // device has a separate one, and the frame's draw waits for them; the recorder returns
+  // whether it recorded anything there, and the transfer submission is skipped when not.
+  void setTransferRecorder(std::function<bool(const UploadCommands&)> recorder) {
+    transferRecorder_ = std::move(recorder);
+  }
   void run(const std::function<void()>& perFrame);
+  // Draws a single frame, for callers that drive their own loop (e.g. uvk_bench).
+  void renderFrame();
   void shutdown();
 
   [[nodiscard]] VulkanContext& context() noexcept { return context_; }
+  [[nodiscard]] PipelineCache& pipelineCache() noexcept { return pipelineCache_; }
+  [[nodiscard]] bool offscreen() const noexcept { return offscreen_; }
+  [[nodiscard]] VkExtent2D extent() const noexcept { return swapchainExtent_; }
+  [[nodiscard]] size_t framesInFlight() const noexcept { return framesInFlight_; }
 
  private:
+  // Mirrors the FrameData uniform block in waterfall.vert.glsl (std140).
+  struct FrameData {
+    float projection[16];
+    float metrics[4];
+    // binCount, total rows, rowsPerTier, tierCount.
+    float layout[4];
+    // WaterfallFormat, minDb, maxDb, first word of the history copy being drawn.
+    float encoding[4];
+    // Head row of each tier; two vec4s in the shader.
+    float tierHeads[kMaxWaterfallTiers];
+  };
+
+  using GraphicsPipelines = std::array<VkPipeline, kWaterfallDrawModeCount>;
+
+  // Everything one in-flight frame owns, so the CPU can record frame N+1 while the GPU is
+  // still executing frame N.
+  struct FrameResources {
+    // Re-recorded every frame with buffer uploads; the draw itself is pre-recorded.
+    VkCommandBuffer uploadCommands{VK_NULL_HANDLE};
+    // Copies for the dedicated transfer queue, if there is one.
+    VkCommandBuffer transferCommands{VK_NULL_HANDLE};
+    // Value of uploadTimeline_ the draw waits for; 0 when nothing was submitted.
+    uint64_t uploadValue{0};
+    VkSemaphore imageAvailable{VK_NULL_HANDLE};
+    VkFence inFlight{VK_NULL_HANDLE};
+    // Value of frameTimeline_ signalled by this frame's last submission. Counted without
+    // timeline semaphores too, to tell when retired resources are free.
+    uint64_t timelineValue{0};
+    // First of this slot's queries in timestampPool_.
+    uint32_t queryBase{0};
+    // Pre-recorded; appended after the draw to write its end timestamp.
+    VkCommandBuffer timestampCommands{VK_NULL_HANDLE};
+    // Set while the last submission's timestamps are still to be read back.
+    bool graphicsTimestamps{false};
+    bool transferTimestamps{false};
+    // Whether transferCommands holds anything to submit this frame.
+    bool transferRecorded{false};
+    // CPU time of the submission, where its GPU intervals are placed on the profiler timeline.
+    uint64_t submitNs{0};
+  };
+
+  // One per swapchain image (offscreen: one per frame slot). Its draw commands are recorded
+  // once and only re-recorded when the swapchain or waterfall layout changes; everything that
+  // varies per frame is read from this target's slice of frameDataBuffer_.
+  struct DrawTarget {
+    VkCommandBuffer drawCommands{VK_NULL_HANDLE};
+    VkDescriptorSet descriptorSet{VK_NULL_HANDLE};
+    // Completion of the last submission that used this target.
+    VkFence lastFence{VK_NULL_HANDLE};
+    uint64_t lastTimelineValue{0};
+    // drawGeneration_ the descriptor set and draw commands were last written for.
+    uint64_t generation{0};
+  };
+
+  // Released once every submission up to timelineValue has completed.
+  struct RetiredResources {
+    uint64_t timelineValue{0};
+    std::function<void()> release;
+  };
+
   void initWindow(const std::string& title, int width, int height);
   void createSurface();
   void createSwapchain();
+  void createOffscreenTarget();
   void createImageViews();
   void createRenderPass();
+  void createPipelineLayout();
+  // Starts building the graphics pipeline on a background thread; waitForPipeline() joins it.
   void createPipeline();
+  void waitForPipeline();
+  GraphicsPipelines buildGraphicsPipelines(VkRenderPass renderPass);
   void createDescriptorSetLayout();
   void createDescriptorPool();
-  void createDescriptorSet();
+  void createDescriptorSets();
+  void writeDescriptorSet(size_t targetIndex);
+  // Rebuilds the surface index buffer for the current bin count and history length.
+  void createWaterfallMesh();
+  // Device-local buffer filled through a temporary staging buffer; blocks until the copy is done.
+  VulkanBuffer createStaticBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage);
   void createFramebuffers();
   void createDepthResources();
   void createCommandPool();
-  void createCommandBuffers();
-  void createSyncObjects();
+  void createFrameResources();
+  void createRenderFinishedSemaphores();
+  void destroyFrameResources();
+  // GPU timestamps around each frame's uploads and draw, written while the profiler is
+  // enabled and read back once the frame slot comes around again.
+  void createTimestampQueries();
+  void readTimestamps(FrameResources& frame);
+  void createDrawTargets();
+  void destroyDrawTargets();
+  // Also re-points the target's descriptor set after a source switch, so the target's last
+  // submission must have completed.
+  void recordDrawTarget(size_t targetIndex);
+  // Frees `release` after everything submitted so far has completed.
+  void retire(std::function<void()> release);
+  void releaseRetired();
+  // Image views, depth target and framebuffers: everything a resize has to rebuild.
+  void destroySwapchainImages();
+  void destroyRenderPass();
   void cleanupSwapchain();
   void recreateSwapchain();
   void drawFrame();
+  void waitForFrame(const FrameResources& frame);
+  void waitForTarget(const DrawTarget& target);
+  void writeFrameData(size_t targetIndex);
+  void recordUploads(FrameResources& frame);
+  // Copies a switched-in source's surface indices out of meshIndexStaging_.
+  void recordIndexUpload(VkCommandBuffer commandBuffer);
+  // Submits frame.transferCommands on the transfer queue and sets frame.uploadValue; without a
+  // dedicated transfer queue it only clears frame.uploadValue.
+  void submitUploads(FrameResources& frame);
+  void submitFrame(FrameResources& frame, DrawTarget& target, bool readback,
+                   VkSemaphore waitSemaphore, VkSemaphore signalSemaphore);
+  void drawOffscreenFrame(bool readback);
+  void runOffscreen(const std::function<void()>& perFrame);
+  // Shows the profiler's per-stage p95 in the window title while profiling; F3 toggles it.
+  void updateProfileOverlay();
+  // Frame queue depth, pending releases and GPU allocations, sampled once per frame into the
+  // trace while tracing.
+  void traceCounters();
+  void recordRenderPass(VkCommandBuffer commandBuffer, uint32_t framebufferIndex,
+                        VkDescriptorSet descriptorSet);
+  void recordReadback(VkCommandBuffer commandBuffer);
+  void writeReadback(const std::string& path);
   void updateMVP();
 
   struct MVP {
@@ -52,9 +233,6 @@ class VulkanApp {
     float model[16];
   } mvp_{};
 
-  static std::vector<char> readFile(const std::string& path);
-  VkShaderModule createShaderModule(const std::vector<char>& code);
-
   GLFWwindow* window_{nullptr};
   VkSurfaceKHR surface_{VK_NULL_HANDLE};
   VkSwapchainKHR swapchain_{VK_NULL_HANDLE};
@@ -65,24 +243,72 @@ class VulkanApp {
   VkRenderPass renderPass_{VK_NULL_HANDLE};
   VkDescriptorSetLayout descriptorSetLayout_{VK_NULL_HANDLE};
   VkDescriptorPool descriptorPool_{VK_NULL_HANDLE};
-  VkDescriptorSet descriptorSet_{VK_NULL_HANDLE};
   VkPipelineLayout pipelineLayout_{VK_NULL_HANDLE};
-  VkPipeline graphicsPipeline_{VK_NULL_HANDLE};
+  // Indexed by WaterfallDrawMode.
+  GraphicsPipelines graphicsPipelines_{};
+  std::string pipelineCachePath_{PipelineCache::defaultPath()};
+  std::future<GraphicsPipelines> pipelineBuild_;
+  // Written by the compile thread, read after pipelineBuild_ has been joined.
+  double pipelineBuildMs_{0.0};
+  bool pipelineReported_{false};
   std::vector<VkFramebuffer> swapchainFramebuffers_;
   VkCommandPool commandPool_{VK_NULL_HANDLE};
-  std::vector<VkCommandBuffer> commandBuffers_;
-  VkSemaphore imageAvailableSemaphore_{VK_NULL_HANDLE};
-  VkSemaphore renderFinishedSemaphore_{VK_NULL_HANDLE};
-  VkFence inFlightFence_{VK_NULL_HANDLE};
+  // On the transfer family; only created with a dedicated transfer queue.
+  VkCommandPool transferCommandPool_{VK_NULL_HANDLE};
+  std::vector<FrameResources> frames_;
+  std::vector<DrawTarget> drawTargets_;
+  VulkanBuffer frameDataBuffer_{};
+  VkDeviceSize frameDataStride_{0};
+  VkCommandBuffer readbackCommands_{VK_NULL_HANDLE};
+  // Indexed by swapchain image: presentation may still be waiting on an image's semaphore
+  // after its frame slot has been reused.
+  std::vector<VkSemaphore> renderFinishedSemaphores_;
+  VkSemaphore frameTimeline_{VK_NULL_HANDLE};
+  uint64_t timelineValue_{0};
+  // Highest frame value known to have completed.
+  uint64_t completedValue_{0};
+  std::vector<RetiredResources> retired_;
+  // Signalled by transfer-queue submissions; each frame's draw waits for its own uploads.
+  VkSemaphore uploadTimeline_{VK_NULL_HANDLE};
+  uint64_t uploadValue_{0};
+  // Null when the graphics queue has no timestamps; the masks are 0 on queues without them.
+  VkQueryPool timestampPool_{VK_NULL_HANDLE};
+  uint64_t graphicsTimestampMask_{0};
+  uint64_t transferTimestampMask_{0};
+  size_t framesInFlight_{2};
+  size_t currentFrame_{0};
   VkImageView depthImageView_{VK_NULL_HANDLE};
   VkImage depthImage_{VK_NULL_HANDLE};
   VkDeviceMemory depthImageMemory_{VK_NULL_HANDLE};
+  VkImage offscreenImage_{VK_NULL_HANDLE};
+  VkDeviceMemory offscreenImageMemory_{VK_NULL_HANDLE};
+  VulkanBuffer readbackBuffer_{};
+  OffscreenOptions offscreenOptions_{};
+  bool offscreen_{false};
 
   VulkanContext context_;
+  // Declared after context_ so it is torn down while the device still exists.
+  PipelineCache pipelineCache_;
   VulkanBuffer waterfallBuffer_{};
-  VulkanBuffer analysisBuffer_{};
-  size_t waterfallBinCount_{0};
-  size_t waterfallHistoryLength_{0};
+  std::array<float, 4> analysisMetrics_{};
+  WaterfallLayout waterfallLayout_{};
+  std::array<size_t, kMaxWaterfallTiers> waterfallHeads_{};
+  size_t waterfallCopy_{0};
+  WaterfallDrawMode drawMode_{WaterfallDrawMode::Surface};
+  VulkanBuffer meshIndexBuffer_{};
+  uint32_t meshIndexCount_{0};
+  VkIndexType meshIndexType_{VK_INDEX_TYPE_UINT32};
+  // Source of meshIndexBuffer_ until the next frame's upload commands copy it.
+  VulkanBuffer meshIndexStaging_{};
+  // Bumped whenever something baked into the pre-recorded draws changes (source, draw mode,
+  // framebuffers); a target behind it is re-recorded before its next use, once its own last
+  // submission has completed.
+  uint64_t drawGeneration_{0};
+  std::function<void(int)> keyHandler_;
+  std::string title_;
+  bool profileOverlay_{true};
+  size_t overlayFrame_{0};
+  std::function<bool(const UploadCommands&)> transferRecorder_;
   bool initialized_{false};
 };
 
@@ -1,5 +1,6 @@
 #include "vulkan_context.h"
 
+#include <algorithm>
 #include <stdexcept>
 #include <vector>
 
@@ -48,6 +49,7 @@ void VulkanContext::initializeDeviceWithSurface(
 void VulkanContext::shutdown() {
   if (device_ != VK_NULL_HANDLE) {
     vkDeviceWaitIdle(device_);
+    allocator_.shutdown();
     vkDestroyDevice(device_, nullptr);
     device_ = VK_NULL_HANDLE;
   }
@@ -99,14 +101,40 @@ void VulkanContext::pickPhysicalDevice(const std::vector<const char*>& deviceExt
   if (physicalDevice_ == VK_NULL_HANDLE) {
     throw std::runtime_error("No suitable Vulkan physical device found.");
   }
+  vkGetPhysicalDeviceProperties(physicalDevice_, &properties_);
   vkGetPhysicalDeviceMemoryProperties(physicalDevice_, &memoryProperties_);
 }
 
 void VulkanContext::createDevice(const std::vector<const char*>& deviceExtensions) {
   findQueueFamilies(physicalDevice_);
+
+  // Timeline semaphores are core in 1.2 but still an optional feature bit on some drivers.
+  const VkPhysicalDeviceProperties& properties = properties_;
+  VkPhysicalDeviceVulkan12Features supported12{};
+  supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  if (properties.apiVersion >= VK_API_VERSION_1_2) {
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(physicalDevice_, &features);
+  }
+  VkPhysicalDeviceVulkan12Features enabled12{};
+  enabled12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  enabled12.timelineSemaphore = supported12.timelineSemaphore;
+  timelineSemaphores_ = enabled12.timelineSemaphore == VK_TRUE;
+  enabled12.hostQueryReset = supported12.hostQueryReset;
+  hostQueryReset_ = enabled12.hostQueryReset == VK_TRUE;
+  if (!timelineSemaphores_) {
+    // Uploads on a second queue are ordered against the frames with timeline values.
+    transferFamilyIndex_ = graphicsFamilyIndex_;
+  }
+
   std::vector<uint32_t> uniqueFamilies = {graphicsFamilyIndex_};
-  if (presentFamilyIndex_ != graphicsFamilyIndex_) {
-    uniqueFamilies.push_back(presentFamilyIndex_);
+  for (uint32_t family : {presentFamilyIndex_, transferFamilyIndex_}) {
+    if (std::find(uniqueFamilies.begin(), uniqueFamilies.end(), family) ==
+        uniqueFamilies.end()) {
+      uniqueFamilies.push_back(family);
+    }
   }
 
   std::vector<VkDeviceQueueCreateInfo> queueInfos;
@@ -121,13 +149,11 @@ void VulkanContext::createDevice(const std::vector<const char*>& deviceExtension
     queueInfos.push_back(queueInfo);
   }
 
-  uint32_t queueFamilyCount = 0;
-  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice_, &queueFamilyCount, nullptr);
-  std::vector<VkQueueFamilyProperties> families(queueFamilyCount);
-  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice_, &queueFamilyCount, families.data());
-
   VkDeviceCreateInfo deviceInfo{};
   deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  if (properties.apiVersion >= VK_API_VERSION_1_2) {
+    deviceInfo.pNext = &enabled12;
+  }
   deviceInfo.queueCreateInfoCount = static_cast<uint32_t>(queueInfos.size());
   deviceInfo.pQueueCreateInfos = queueInfos.data();
   deviceInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
@@ -139,6 +165,8 @@ void VulkanContext::createDevice(const std::vector<const char*>& deviceExtension
 
   vkGetDeviceQueue(device_, graphicsFamilyIndex_, 0, &graphicsQueue_);
   vkGetDeviceQueue(device_, presentFamilyIndex_, 0, &presentQueue_);
+  vkGetDeviceQueue(device_, transferFamilyIndex_, 0, &transferQueue_);
+  allocator_.initialize(physicalDevice_, device_);
 }
 
 bool VulkanContext::isDeviceSuitable(
@@ -190,10 +218,22 @@ void VulkanContext::findQueueFamilies(VkPhysicalDevice device) {
 
   std::optional<uint32_t> graphicsFamily;
   std::optional<uint32_t> presentFamily;
+  std::optional<uint32_t> transferOnlyFamily;
+  std::optional<uint32_t> asyncComputeFamily;
+  timestampValidBits_.assign(queueFamilyCount, 0);
 
   for (uint32_t i = 0; i < queueFamilyCount; ++i) {
-    if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+    timestampValidBits_[i] = families[i].timestampValidBits;
+    const VkQueueFlags flags = families[i].queueFlags;
+    if (flags & VK_QUEUE_GRAPHICS_BIT) {
       graphicsFamily = i;
+    } else if (flags & VK_QUEUE_COMPUTE_BIT) {
+      // Compute queues always accept transfer commands.
+      if (!asyncComputeFamily.has_value()) {
+        asyncComputeFamily = i;
+      }
+    } else if ((flags & VK_QUEUE_TRANSFER_BIT) && !transferOnlyFamily.has_value()) {
+      transferOnlyFamily = i;
     }
     if (surface_ != VK_NULL_HANDLE) {
       VkBool32 presentSupport = VK_FALSE;
@@ -212,6 +252,9 @@ void VulkanContext::findQueueFamilies(VkPhysicalDevice device) {
   } else {
     presentFamilyIndex_ = graphicsFamilyIndex_;
   }
+  // Transfer-only families are usually backed by copy engines that run beside rendering.
+  transferFamilyIndex_ = transferOnlyFamily.value_or(asyncComputeFamily.value_or(
+      graphicsFamilyIndex_));
 }
 
 uint32_t VulkanContext::findMemoryType(uint32_t typeFilter,
@@ -226,7 +269,8 @@ uint32_t VulkanContext::findMemoryType(uint32_t typeFilter,
 }
 
 VulkanBuffer VulkanContext::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
-                                         VkMemoryPropertyFlags properties) {
+                                         VkMemoryPropertyFlags properties,
+                                         AllocationStrategy strategy) {
   VulkanBuffer buffer{};
   buffer.size = size;
 
@@ -242,14 +286,15 @@ VulkanBuffer VulkanContext::createBuffer(VkDeviceSize size, VkBufferUsageFlags u
   VkMemoryRequirements requirements{};
   vkGetBufferMemoryRequirements(device_, buffer.buffer, &requirements);
 
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = requirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
-
-  checkVk(vkAllocateMemory(device_, &allocInfo, nullptr, &buffer.memory),
-          "Failed to allocate Vulkan buffer memory.");
-  checkVk(vkBindBufferMemory(device_, buffer.buffer, buffer.memory, 0),
+  try {
+    buffer.allocation = allocator_.allocate(requirements, properties, strategy);
+  } catch (...) {
+    vkDestroyBuffer(device_, buffer.buffer, nullptr);
+    throw;
+  }
+  buffer.mapped = buffer.allocation.mapped;
+  checkVk(vkBindBufferMemory(device_, buffer.buffer, buffer.allocation.memory,
+                             buffer.allocation.offset),
           "Failed to bind Vulkan buffer memory.");
 
   return buffer;
@@ -260,10 +305,8 @@ void VulkanContext::destroyBuffer(VulkanBuffer& buffer) {
     vkDestroyBuffer(device_, buffer.buffer, nullptr);
     buffer.buffer = VK_NULL_HANDLE;
   }
-  if (buffer.memory != VK_NULL_HANDLE) {
-    vkFreeMemory(device_, buffer.memory, nullptr);
-    buffer.memory = VK_NULL_HANDLE;
-  }
+  allocator_.free(buffer.allocation);
+  buffer.mapped = nullptr;
   buffer.size = 0;
 }
 
@@ -1,17 +1,40 @@
 #pragma once
 
+#include "gpu_allocator.h"
+
 #include <vulkan/vulkan.h>
 
+#include <cstddef>
 #include <optional>
 #include <string>
 #include <vector>
 
 namespace uvk {
 
+// Upper bound on submitted frames the GPU may still be executing at once.
+constexpr size_t kMaxFramesInFlight = 4;
+
 struct VulkanBuffer {
   VkBuffer buffer{VK_NULL_HANDLE};
-  VkDeviceMemory memory{VK_NULL_HANDLE};
   VkDeviceSize size{};
+  GpuAllocation allocation{};
+  // Persistently mapped host pointer for host-visible buffers, nullptr otherwise.
+  void* mapped{nullptr};
+};
+
+// Command buffers a frame's buffer uploads are recorded into. With a dedicated transfer queue
+// the copies go to `transfer` and run on that queue, releasing each written range to the
+// graphics family; `graphics` then records the matching acquire before the data is read.
+// Without one both are the same graphics command buffer and no ownership transfer is needed.
+struct UploadCommands {
+  VkCommandBuffer transfer{VK_NULL_HANDLE};
+  VkCommandBuffer graphics{VK_NULL_HANDLE};
+  uint32_t transferFamily{VK_QUEUE_FAMILY_IGNORED};
+  uint32_t graphicsFamily{VK_QUEUE_FAMILY_IGNORED};
+
+  [[nodiscard]] bool ownershipTransfer() const noexcept {
+    return transferFamily != graphicsFamily;
+  }
 };
 
 class VulkanContext {
@@ -40,13 +63,41 @@ class VulkanContext {
   [[nodiscard]] VkQueue presentQueue() const noexcept { return presentQueue_; }
   [[nodiscard]] uint32_t graphicsFamilyIndex() const noexcept { return graphicsFamilyIndex_; }
   [[nodiscard]] uint32_t presentFamilyIndex() const noexcept { return presentFamilyIndex_; }
+  // A transfer-only family if the device has one, else an async compute family, else the
+  // graphics family. Only separate from graphics when timeline semaphores are available to
+  // order the two queues.
+  [[nodiscard]] VkQueue transferQueue() const noexcept { return transferQueue_; }
+  [[nodiscard]] uint32_t transferFamilyIndex() const noexcept { return transferFamilyIndex_; }
+  [[nodiscard]] bool dedicatedTransferQueue() const noexcept {
+    return transferFamilyIndex_ != graphicsFamilyIndex_;
+  }
+  // True when the device was created with Vulkan 1.2 timeline semaphores enabled.
+  [[nodiscard]] bool timelineSemaphores() const noexcept { return timelineSemaphores_; }
+  // True when queries can be reset from the host (vkResetQueryPool), which transfer-only
+  // queues need since they cannot record query resets.
+  [[nodiscard]] bool hostQueryReset() const noexcept { return hostQueryReset_; }
+  // Valid bits of timestamps written on `family`'s queues; 0 when it has no timestamps.
+  [[nodiscard]] uint32_t timestampValidBits(uint32_t family) const noexcept {
+    return family < timestampValidBits_.size() ? timestampValidBits_[family] : 0;
+  }
+  [[nodiscard]] const VkPhysicalDeviceProperties& properties() const noexcept {
+    return properties_;
+  }
   [[nodiscard]] const VkPhysicalDeviceMemoryProperties& memoryProperties() const noexcept {
     return memoryProperties_;
   }
 
   VulkanBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
-                            VkMemoryPropertyFlags properties);
+                            VkMemoryPropertyFlags properties,
+                            AllocationStrategy strategy = AllocationStrategy::Buddy);
   void destroyBuffer(VulkanBuffer& buffer);
+  // Make host writes visible to the device / device writes visible to the host. Only needed
+  // for memory without HOST_COHERENT; cheap no-ops otherwise.
+  void flushBuffer(const VulkanBuffer& buffer) const { allocator_.flush(buffer.allocation); }
+  void invalidateBuffer(const VulkanBuffer& buffer) const {
+    allocator_.invalidate(buffer.allocation);
+  }
+  [[nodiscard]] GpuMemoryStats memoryStats() const { return allocator_.stats(); }
 
   uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
 
@@ -66,10 +117,17 @@ class VulkanContext {
   VkDevice device_{VK_NULL_HANDLE};
   VkQueue graphicsQueue_{VK_NULL_HANDLE};
   VkQueue presentQueue_{VK_NULL_HANDLE};
+  VkQueue transferQueue_{VK_NULL_HANDLE};
   uint32_t graphicsFamilyIndex_{0};
   uint32_t presentFamilyIndex_{0};
+  uint32_t transferFamilyIndex_{0};
+  bool timelineSemaphores_{false};
+  bool hostQueryReset_{false};
+  std::vector<uint32_t> timestampValidBits_;
   VkSurfaceKHR surface_{VK_NULL_HANDLE};
+  VkPhysicalDeviceProperties properties_{};
   VkPhysicalDeviceMemoryProperties memoryProperties_{};
+  GpuAllocator allocator_;
 };
 
 }  // namespace uvk
@@ -0,0 +1,172 @@
+#include "waterfall_format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace uvk {
+
+namespace {
+
+uint32_t floatBits(float value) noexcept {
+  uint32_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+float bitsToFloat(uint32_t bits) noexcept {
+  float value = 0.0f;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+}  // namespace
+
+size_t waterfallBytesPerSample(WaterfallFormat format) noexcept {
+  switch (format) {
+    case WaterfallFormat::Float16:
+      return 2;
+    case WaterfallFormat::Db8:
+      return 1;
+    case WaterfallFormat::Float32:
+      break;
+  }
+  return 4;
+}
+
+size_t WaterfallLayout::copyWords() const noexcept {
+  return (waterfallBytesPerSample(encoding.format) * binCount * rowCount() + 3) / 4;
+}
+
+const char* waterfallFormatName(WaterfallFormat format) noexcept {
+  switch (format) {
+    case WaterfallFormat::Float16:
+      return "f16";
+    case WaterfallFormat::Db8:
+      return "db8";
+    case WaterfallFormat::Float32:
+      break;
+  }
+  return "f32";
+}
+
+bool parseWaterfallFormat(const std::string& name, WaterfallFormat* format) {
+  if (name == "f32") {
+    *format = WaterfallFormat::Float32;
+  } else if (name == "f16") {
+    *format = WaterfallFormat::Float16;
+  } else if (name == "db8") {
+    *format = WaterfallFormat::Db8;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+uint16_t floatToHalf(float value) noexcept {
+  // Each case is computed and the result selected, so the loops calling this stay branch-free
+  // and vectorize.
+  const uint32_t bits = floatBits(value);
+  const uint32_t sign = (bits >> 16) & 0x8000u;
+  const uint32_t magnitude = bits & 0x7FFFFFFFu;
+  // Normal halves: rebias the exponent (127 -> 15) and round the mantissa to nearest even.
+  const uint32_t normal = (magnitude + 0xC8000FFFu + ((magnitude >> 13) & 1u)) >> 13;
+  // Subnormal halves: adding 0.5 lines the mantissa up so the FPU does the rounding.
+  const uint32_t subnormal = floatBits(bitsToFloat(magnitude) + 0.5f) - 0x3F000000u;
+  const uint32_t special = magnitude > 0x7F800000u ? 0x7E00u : 0x7C00u;
+  const uint32_t half = magnitude >= 0x47800000u  ? special
+                        : magnitude < 0x38800000u ? subnormal
+                                                  : normal;
+  return static_cast<uint16_t>(half | sign);
+}
+
+float halfToFloat(uint16_t value) noexcept {
+  const uint32_t shifted = (static_cast<uint32_t>(value) & 0x7FFFu) << 13;
+  const uint32_t exponent = shifted & 0x0F800000u;
+  uint32_t bits = shifted + 0x38000000u;
+  if (exponent == 0x0F800000u) {
+    bits += 0x38000000u;
+  } else if (exponent == 0) {
+    bits = floatBits(bitsToFloat(bits + 0x00800000u) - bitsToFloat(0x38800000u));
+  }
+  return bitsToFloat(bits | ((static_cast<uint32_t>(value) & 0x8000u) << 16));
+}
+
+WaterfallCodec::WaterfallCodec(const WaterfallEncoding& encoding) : encoding_(encoding) {
+  if (!(encoding_.maxDb > encoding_.minDb)) {
+    encoding_.maxDb = encoding_.minDb + 1.0f;
+  }
+  const float step = (encoding_.maxDb - encoding_.minDb) / 255.0f;
+  dbTable_[0] = 0.0f;
+  for (size_t code = 1; code < dbTable_.size(); ++code) {
+    dbTable_[code] =
+        std::pow(10.0f, (encoding_.minDb + step * static_cast<float>(code)) / 20.0f);
+  }
+}
+
+void WaterfallCodec::encode(const float* input, size_t count, unsigned char* output) const {
+  switch (encoding_.format) {
+    case WaterfallFormat::Float32:
+      std::memcpy(output, input, sizeof(float) * count);
+      return;
+    case WaterfallFormat::Float16: {
+      size_t i = 0;
+#if defined(__F16C__)
+      for (; i + 8 <= count; i += 8) {
+        const __m128i halves =
+            _mm256_cvtps_ph(_mm256_loadu_ps(input + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i * 2), halves);
+      }
+#endif
+      for (; i < count; ++i) {
+        const uint16_t half = floatToHalf(input[i]);
+        std::memcpy(output + i * 2, &half, sizeof(half));
+      }
+      return;
+    }
+    case WaterfallFormat::Db8: {
+      const float scale = 255.0f / (encoding_.maxDb - encoding_.minDb);
+      const float offset = -encoding_.minDb * scale + 0.5f;
+      for (size_t i = 0; i < count; ++i) {
+        // Magnitudes at or below the floor (including 0) clamp to code 0.
+        const float db = 20.0f * std::log10(std::max(input[i], 1e-30f));
+        output[i] = static_cast<unsigned char>(std::clamp(db * scale + offset, 0.0f, 255.0f));
+      }
+      return;
+    }
+  }
+}
+
+void WaterfallCodec::decode(const unsigned char* input, size_t count, float* output) const {
+  switch (encoding_.format) {
+    case WaterfallFormat::Float32:
+      std::memcpy(output, input, sizeof(float) * count);
+      return;
+    case WaterfallFormat::Float16: {
+      size_t i = 0;
+#if defined(__F16C__)
+      for (; i + 8 <= count; i += 8) {
+        const __m128i halves = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i * 2));
+        _mm256_storeu_ps(output + i, _mm256_cvtph_ps(halves));
+      }
+#endif
+      for (; i < count; ++i) {
+        uint16_t half = 0;
+        std::memcpy(&half, input + i * 2, sizeof(half));
+        output[i] = halfToFloat(half);
+      }
+      return;
+    }
+    case WaterfallFormat::Db8:
+      for (size_t i = 0; i < count; ++i) {
+        output[i] = dbTable_[input[i]];
+      }
+      return;
+  }
+}
+
+}  // namespace uvk
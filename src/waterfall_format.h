@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace uvk {
+
+enum class WaterfallFormat {
+  Float32,
+  // IEEE half precision, decoded with unpackHalf2x16 in the vertex shader.
+  Float16,
+  // 8-bit code over [minDb, maxDb]; code 0 means silence.
+  Db8,
+};
+
+struct WaterfallEncoding {
+  WaterfallFormat format{WaterfallFormat::Float32};
+  float minDb{-100.0f};
+  float maxDb{0.0f};
+};
+
+// Upper bound on history tiers; the vertex shader receives one head row per tier.
+inline constexpr size_t kMaxWaterfallTiers = 8;
+// Upper bound on whole copies of the history kept in the storage buffer.
+inline constexpr size_t kMaxWaterfallCopies = 2;
+
+// How the waterfall storage buffer is laid out, as the vertex shader needs to know it. Tier t
+// is a ring of rowsPerTier rows at physical rows [t * rowsPerTier, (t + 1) * rowsPerTier);
+// logical row r (0 newest) is row r % rowsPerTier of tier r / rowsPerTier.
+struct WaterfallLayout {
+  size_t binCount{};
+  size_t rowsPerTier{};
+  size_t tierCount{1};
+  WaterfallEncoding encoding{};
+  // Copies of the whole history stored back to back, copyWords() 32-bit words apart. With
+  // two, frames alternate between them, so one frame's uploads never overwrite rows the
+  // previous frame's draw may still be reading.
+  size_t copies{1};
+
+  [[nodiscard]] size_t rowCount() const noexcept { return rowsPerTier * tierCount; }
+  // One copy, padded to whole words.
+  [[nodiscard]] size_t copyWords() const noexcept;
+};
+
+[[nodiscard]] size_t waterfallBytesPerSample(WaterfallFormat format) noexcept;
+[[nodiscard]] const char* waterfallFormatName(WaterfallFormat format) noexcept;
+bool parseWaterfallFormat(const std::string& name, WaterfallFormat* format);
+
+[[nodiscard]] uint16_t floatToHalf(float value) noexcept;
+[[nodiscard]] float halfToFloat(uint16_t value) noexcept;
+
+// Quantizes waterfall rows once on the way in and expands them again for CPU-side analysis.
+// Every format decodes to linear magnitude, so the renderer and the statistics see the same
+// scale whichever storage is used.
+class WaterfallCodec {
+ public:
+  explicit WaterfallCodec(const WaterfallEncoding& encoding = {});
+
+  void encode(const float* input, size_t count, unsigned char* output) const;
+  void decode(const unsigned char* input, size_t count, float* output) const;
+
+  [[nodiscard]] const WaterfallEncoding& encoding() const noexcept { return encoding_; }
+  [[nodiscard]] size_t bytesPerSample() const noexcept {
+    return waterfallBytesPerSample(encoding_.format);
+  }
+
+ private:
+  WaterfallEncoding encoding_;
+  // Linear magnitude for each 8-bit code.
+  std::array<float, 256> dbTable_{};
+};
+
+}  // namespace uvk
@@ -0,0 +1,81 @@
+#include "waterfall_mesh.h"
+
+#include <algorithm>
+
+namespace uvk {
+
+namespace {
+
+size_t columnCount(size_t binCount, size_t step) {
+  // 0, step, 2 * step, ... plus the last bin when the grid does not land on it.
+  const size_t regular = (binCount - 1) / step + 1;
+  return (binCount - 1) % step == 0 ? regular : regular + 1;
+}
+
+size_t columnAt(size_t index, size_t binCount, size_t step) {
+  return std::min(index * step, binCount - 1);
+}
+
+// Largest column of the coarser grid that does not lie right of `column`.
+size_t snapColumn(size_t column, size_t binCount, size_t step) {
+  return column == binCount - 1 ? column : column / step * step;
+}
+
+}  // namespace
+
+size_t waterfallLodStep(size_t row, size_t binCount, const WaterfallLodOptions& options) {
+  size_t maxStep = 1;
+  while (maxStep * 2 * std::max<size_t>(options.minColumns, 1) <= binCount) {
+    maxStep *= 2;
+  }
+  size_t step = 1;
+  size_t bandLength = std::max<size_t>(options.fullDetailRows, 1);
+  size_t bandEnd = bandLength;
+  while (row >= bandEnd && step < maxStep) {
+    step *= 2;
+    bandLength *= 2;
+    bandEnd += bandLength;
+  }
+  return step;
+}
+
+WaterfallMesh buildWaterfallMesh(size_t binCount, size_t historyLength,
+                                 const WaterfallLodOptions& options) {
+  WaterfallMesh mesh;
+  if (binCount < 2 || historyLength < 2) {
+    return mesh;
+  }
+
+  std::vector<size_t> rows;
+  for (size_t row = 0;;) {
+    rows.push_back(row);
+    mesh.vertexCount += columnCount(binCount, waterfallLodStep(row, binCount, options));
+    if (row == historyLength - 1) {
+      break;
+    }
+    row = std::min(row + waterfallLodStep(row, binCount, options), historyLength - 1);
+  }
+
+  for (size_t i = 0; i + 1 < rows.size(); ++i) {
+    const size_t top = rows[i];
+    const size_t bottom = rows[i + 1];
+    const size_t topStep = waterfallLodStep(top, binCount, options);
+    const size_t bottomStep = waterfallLodStep(bottom, binCount, options);
+    if (mesh.stripCount > 0) {
+      mesh.indices.push_back(kPrimitiveRestartIndex);
+    }
+    // Where bottomStep is coarser, several top columns share one bottom vertex; the repeated
+    // vertex only produces zero-area triangles.
+    const size_t columns = columnCount(binCount, topStep);
+    for (size_t c = 0; c < columns; ++c) {
+      const size_t column = columnAt(c, binCount, topStep);
+      mesh.indices.push_back(static_cast<uint32_t>(top * binCount + column));
+      mesh.indices.push_back(
+          static_cast<uint32_t>(bottom * binCount + snapColumn(column, binCount, bottomStep)));
+    }
+    ++mesh.stripCount;
+  }
+  return mesh;
+}
+
+}  // namespace uvk
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace uvk {
+
+inline constexpr uint32_t kPrimitiveRestartIndex = 0xFFFFFFFFu;
+
+struct WaterfallLodOptions {
+  // The newest rows are drawn at full bin and row resolution.
+  size_t fullDetailRows{16};
+  // Each following band is twice as long and twice as coarse, until a row would keep fewer
+  // than this many columns.
+  size_t minColumns{16};
+};
+
+// Triangle-strip surface over the waterfall history. There is no vertex buffer: index
+// r * binCount + c names bin c of logical row r (row 0 newest), exactly as in point mode, and
+// the vertex shader resolves it against the ring buffer. Strips are separated by
+// kPrimitiveRestartIndex.
+struct WaterfallMesh {
+  std::vector<uint32_t> indices;
+  // Distinct grid vertices the strips reference, against binCount * historyLength for points.
+  size_t vertexCount{};
+  size_t stripCount{};
+};
+
+// Bin and row step used for logical row `row`; always a power of two.
+size_t waterfallLodStep(size_t row, size_t binCount, const WaterfallLodOptions& options);
+
+// Where two bands meet, the finer strip snaps its lower edge onto the coarser row's columns,
+// so the surface has no T-junction cracks.
+WaterfallMesh buildWaterfallMesh(size_t binCount, size_t historyLength,
+                                 const WaterfallLodOptions& options = {});
+
+}  // namespace uvk
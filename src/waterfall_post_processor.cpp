@@ -0,0 +1,313 @@
+#include "waterfall_post_processor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace uvk {
+
+WaterfallPostProcessor::~WaterfallPostProcessor() {
+  shutdown();
+}
+
+bool WaterfallPostProcessor::supported(const VulkanContext& context) {
+  uint32_t familyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(context.physicalDevice(), &familyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> families(familyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(context.physicalDevice(), &familyCount,
+                                           families.data());
+  const uint32_t family = context.graphicsFamilyIndex();
+  return family < familyCount && (families[family].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+}
+
+void WaterfallPostProcessor::initialize(VulkanContext& context, PipelineCache& pipelineCache,
+                                        const VulkanBuffer& waterfall,
+                                        const WaterfallLayout& history,
+                                        const WaterfallPostProcessOptions& options) {
+  if (context_) {
+    shutdown();
+  }
+  if (history.tierCount != 1 || history.encoding.format != WaterfallFormat::Float32) {
+    throw std::runtime_error("Failed to set up GPU post-processing: needs one f32 tier.");
+  }
+  context_ = &context;
+  history_ = history;
+  options_ = options;
+  waterfall_ = waterfall.buffer;
+  waterfallSize_ = waterfall.size;
+  groupCount_ = static_cast<uint32_t>((history.rowsPerTier + kRowsPerGroup - 1) / kRowsPerGroup);
+  pendingRow_.assign(history.binCount, 0.0f);
+  rowPending_ = false;
+  clearRequired_ = true;
+  slotWritten_.fill(false);
+  recordCursor_ = 0;
+  bounds_ = {};
+
+  const VkDeviceSize rowBytes = sizeof(float) * history.binCount;
+  rawRow_ = context.createBuffer(
+      rowBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  state_ = context.createBuffer(
+      rowBytes * 2, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  results_ = context.createBuffer(
+      sizeof(float) * kResultFloats * groupCount_ * kMaxFramesInFlight,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+  createDescriptors();
+  createPipelines(pipelineCache);
+}
+
+void WaterfallPostProcessor::shutdown() {
+  if (!context_) {
+    return;
+  }
+  VkDevice device = context_->device();
+  for (VkPipeline& pipeline : pipelines_) {
+    if (pipeline != VK_NULL_HANDLE) {
+      vkDestroyPipeline(device, pipeline, nullptr);
+      pipeline = VK_NULL_HANDLE;
+    }
+  }
+  if (pipelineLayout_ != VK_NULL_HANDLE) {
+    vkDestroyPipelineLayout(device, pipelineLayout_, nullptr);
+    pipelineLayout_ = VK_NULL_HANDLE;
+  }
+  if (descriptorPool_ != VK_NULL_HANDLE) {
+    vkDestroyDescriptorPool(device, descriptorPool_, nullptr);
+    descriptorPool_ = VK_NULL_HANDLE;
+    descriptorSet_ = VK_NULL_HANDLE;
+  }
+  if (descriptorSetLayout_ != VK_NULL_HANDLE) {
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayout_, nullptr);
+    descriptorSetLayout_ = VK_NULL_HANDLE;
+  }
+  context_->destroyBuffer(results_);
+  context_->destroyBuffer(state_);
+  context_->destroyBuffer(rawRow_);
+  waterfall_ = VK_NULL_HANDLE;
+  pendingRow_.clear();
+  context_ = nullptr;
+}
+
+void WaterfallPostProcessor::createDescriptors() {
+  VkDescriptorSetLayoutBinding bindings[4]{};
+  for (uint32_t i = 0; i < 4; ++i) {
+    bindings[i].binding = i;
+    bindings[i].descriptorCount = 1;
+    bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 4;
+  layoutInfo.pBindings = bindings;
+  if (vkCreateDescriptorSetLayout(context_->device(), &layoutInfo, nullptr,
+                                  &descriptorSetLayout_) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create post-process descriptor set layout.");
+  }
+
+  VkDescriptorPoolSize poolSize{};
+  poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSize.descriptorCount = 4;
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+  poolInfo.maxSets = 1;
+  if (vkCreateDescriptorPool(context_->device(), &poolInfo, nullptr, &descriptorPool_) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create post-process descriptor pool.");
+  }
+
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = descriptorPool_;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &descriptorSetLayout_;
+  if (vkAllocateDescriptorSets(context_->device(), &allocInfo, &descriptorSet_) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to allocate post-process descriptor set.");
+  }
+
+  const VkDescriptorBufferInfo bufferInfos[4] = {
+      {waterfall_, 0, waterfallSize_},
+      {rawRow_.buffer, 0, rawRow_.size},
+      {state_.buffer, 0, state_.size},
+      {results_.buffer, 0, results_.size},
+  };
+  VkWriteDescriptorSet writes[4]{};
+  for (uint32_t i = 0; i < 4; ++i) {
+    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet = descriptorSet_;
+    writes[i].dstBinding = i;
+    writes[i].descriptorCount = 1;
+    writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[i].pBufferInfo = &bufferInfos[i];
+  }
+  vkUpdateDescriptorSets(context_->device(), 4, writes, 0, nullptr);
+}
+
+void WaterfallPostProcessor::createPipelines(PipelineCache& pipelineCache) {
+  VkPushConstantRange pushRange{};
+  pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pushRange.size = sizeof(Params);
+  VkPipelineLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layoutInfo.setLayoutCount = 1;
+  layoutInfo.pSetLayouts = &descriptorSetLayout_;
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges = &pushRange;
+  if (vkCreatePipelineLayout(context_->device(), &layoutInfo, nullptr, &pipelineLayout_) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create post-process pipeline layout.");
+  }
+
+  // Both passes come from one module; a specialization constant selects the entry path.
+  const int32_t passes[2] = {0, 1};
+  VkSpecializationMapEntry passEntry{};
+  passEntry.constantID = 0;
+  passEntry.offset = 0;
+  passEntry.size = sizeof(int32_t);
+  VkSpecializationInfo specializations[2]{};
+  VkComputePipelineCreateInfo pipelineInfos[2]{};
+  for (size_t i = 0; i < 2; ++i) {
+    specializations[i].mapEntryCount = 1;
+    specializations[i].pMapEntries = &passEntry;
+    specializations[i].dataSize = sizeof(int32_t);
+    specializations[i].pData = &passes[i];
+
+    pipelineInfos[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfos[i].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfos[i].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfos[i].stage.module = pipelineCache.shaderModule("waterfall_post.comp.spv");
+    pipelineInfos[i].stage.pName = "main";
+    pipelineInfos[i].stage.pSpecializationInfo = &specializations[i];
+    pipelineInfos[i].layout = pipelineLayout_;
+  }
+  if (vkCreateComputePipelines(context_->device(), pipelineCache.handle(), 2, pipelineInfos,
+                               nullptr, pipelines_.data()) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create post-process compute pipelines.");
+  }
+}
+
+void WaterfallPostProcessor::submitRow(const float* row, size_t headRow) {
+  if (!context_) {
+    return;
+  }
+  std::copy(row, row + history_.binCount, pendingRow_.begin());
+  pendingHead_ = headRow;
+  rowPending_ = true;
+}
+
+void WaterfallPostProcessor::readResults(size_t slot) {
+  context_->invalidateBuffer(results_);
+  const auto* values =
+      static_cast<const float*>(results_.mapped) + slot * groupCount_ * kResultFloats;
+  float minValue = values[0];
+  float maxValue = values[1];
+  double dx = 0.0;
+  double dy = 0.0;
+  double dz = 0.0;
+  for (uint32_t group = 0; group < groupCount_; ++group) {
+    const float* partial = values + group * kResultFloats;
+    minValue = std::min(minValue, partial[0]);
+    maxValue = std::max(maxValue, partial[1]);
+    dx += partial[2];
+    dy += partial[3];
+    dz += partial[4];
+  }
+  const size_t bins = history_.binCount;
+  const size_t rows = history_.rowsPerTier;
+  bounds_.bounds.min = {0.0f, minValue, 0.0f};
+  bounds_.bounds.max = {static_cast<float>(bins - 1), maxValue, static_cast<float>(rows - 1)};
+  const float denom = static_cast<float>((rows - 1) * (bins - 1));
+  bounds_.gradient = {static_cast<float>(dx) / denom, static_cast<float>(dy) / denom,
+                      static_cast<float>(dz) / denom};
+}
+
+void WaterfallPostProcessor::record(VkCommandBuffer commandBuffer) {
+  if (!active() || history_.binCount == 0 || history_.rowsPerTier == 0) {
+    return;
+  }
+  const size_t slot = recordCursor_ % kMaxFramesInFlight;
+  ++recordCursor_;
+  if (slotWritten_[slot]) {
+    readResults(slot);
+  }
+
+  // Earlier frames may still be reading the raw row and drawing from the history.
+  VkMemoryBarrier beforeWrite{};
+  beforeWrite.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  vkCmdPipelineBarrier(commandBuffer,
+                       VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &beforeWrite, 0, nullptr, 0,
+                       nullptr);
+  if (clearRequired_) {
+    vkCmdFillBuffer(commandBuffer, waterfall_, 0, VK_WHOLE_SIZE, 0);
+    vkCmdFillBuffer(commandBuffer, state_.buffer, 0, VK_WHOLE_SIZE, 0);
+    clearRequired_ = false;
+  }
+  if (rowPending_) {
+    // vkCmdUpdateBuffer embeds the data in the command buffer, 64 KiB at a time.
+    constexpr VkDeviceSize kMaxUpdateBytes = 65536;
+    const auto* bytes = reinterpret_cast<const unsigned char*>(pendingRow_.data());
+    for (VkDeviceSize offset = 0; offset < rawRow_.size; offset += kMaxUpdateBytes) {
+      const VkDeviceSize size = std::min(kMaxUpdateBytes, rawRow_.size - offset);
+      vkCmdUpdateBuffer(commandBuffer, rawRow_.buffer, offset, size, bytes + offset);
+    }
+  }
+
+  VkMemoryBarrier uploaded{};
+  uploaded.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  uploaded.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  uploaded.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &uploaded, 0, nullptr, 0,
+                       nullptr);
+
+  Params params{};
+  params.bins = static_cast<uint32_t>(history_.binCount);
+  params.rows = static_cast<uint32_t>(history_.rowsPerTier);
+  params.headRow = static_cast<uint32_t>(pendingHead_);
+  params.rowsPerGroup = kRowsPerGroup;
+  params.resultOffset = static_cast<uint32_t>(slot * groupCount_ * kResultFloats);
+  params.decibels = options_.decibels ? 1u : 0u;
+  params.minDb = history_.encoding.minDb;
+  params.maxDb = history_.encoding.maxDb;
+  params.smoothing = std::clamp(options_.smoothing, 0.0f, 1.0f);
+  params.peakDecay = std::clamp(options_.peakDecay, 0.0f, 1.0f);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1,
+                          &descriptorSet_, 0, nullptr);
+  vkCmdPushConstants(commandBuffer, pipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                     sizeof(Params), &params);
+
+  if (rowPending_) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines_[0]);
+    vkCmdDispatch(commandBuffer,
+                  static_cast<uint32_t>((history_.binCount + kWorkgroupSize - 1) / kWorkgroupSize),
+                  1, 1);
+    VkMemoryBarrier processed{};
+    processed.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    processed.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    processed.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &processed, 0, nullptr, 0,
+                         nullptr);
+    rowPending_ = false;
+  }
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines_[1]);
+  vkCmdDispatch(commandBuffer, groupCount_, 1, 1);
+  slotWritten_[slot] = true;
+
+  // The draw reads the history; the host reads the results once this submission completes.
+  VkMemoryBarrier reduced{};
+  reduced.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  reduced.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  reduced.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                       &reduced, 0, nullptr, 0, nullptr);
+}
+
+}  // namespace uvk
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "differential_math.h"
+#include "pipeline_cache.h"
+#include "vulkan_context.h"
+#include "waterfall_format.h"
+
+#include <array>
+#include <vector>
+
+namespace uvk {
+
+struct WaterfallPostProcessOptions {
+  bool enabled{false};
+  // Map magnitudes to [0, 1] over the encoding's dB range before smoothing.
+  bool decibels{true};
+  // Weight of the previous smoothed value per column; 0 disables smoothing.
+  float smoothing{0.5f};
+  // Factor held peaks decay by per row; 0 disables peak hold.
+  float peakDecay{0.0f};
+};
+
+// Optional compute stage that moves per-row work off the CPU. Each frame the CPU uploads one
+// raw aggregated row; a compute pass maps it to dB, smooths it, applies peak hold and writes
+// it into the float32 waterfall history, then a second pass reduces the history to bounds and
+// gradient sums. Only core Vulkan 1.0 compute is used, so it runs on lavapipe.
+class WaterfallPostProcessor {
+ public:
+  ~WaterfallPostProcessor();
+
+  // False when the graphics queue cannot run compute work.
+  static bool supported(const VulkanContext& context);
+
+  // `history` must be a single tier of Float32 rows in `waterfall`.
+  void initialize(VulkanContext& context, PipelineCache& pipelineCache,
+                  const VulkanBuffer& waterfall, const WaterfallLayout& history,
+                  const WaterfallPostProcessOptions& options);
+  void shutdown();
+
+  // Queues `row` (binCount floats) to be written at physical row `headRow` by the next record().
+  void submitRow(const float* row, size_t headRow);
+  // Records the row upload and both compute passes. Must be called outside a render pass,
+  // before the draw that reads the waterfall.
+  void record(VkCommandBuffer commandBuffer);
+
+  // Reduction results from the most recent completed submission, a few frames behind.
+  [[nodiscard]] const DifferentialBounds& bounds() const noexcept { return bounds_; }
+  [[nodiscard]] bool active() const noexcept { return pipelines_[0] != VK_NULL_HANDLE; }
+
+ private:
+  // Mirrors the push constant block in waterfall_post.comp.glsl.
+  struct Params {
+    uint32_t bins;
+    uint32_t rows;
+    uint32_t headRow;
+    uint32_t rowsPerGroup;
+    uint32_t resultOffset;
+    uint32_t decibels;
+    float minDb;
+    float maxDb;
+    float smoothing;
+    float peakDecay;
+  };
+
+  static constexpr uint32_t kWorkgroupSize = 64;
+  static constexpr uint32_t kRowsPerGroup = 8;
+  static constexpr size_t kResultFloats = 8;
+
+  void createDescriptors();
+  void createPipelines(PipelineCache& pipelineCache);
+  void readResults(size_t slot);
+
+  VulkanContext* context_{nullptr};
+  WaterfallLayout history_{};
+  WaterfallPostProcessOptions options_{};
+  VkBuffer waterfall_{VK_NULL_HANDLE};
+  VkDeviceSize waterfallSize_{};
+  VulkanBuffer rawRow_{};
+  VulkanBuffer state_{};
+  // kMaxFramesInFlight slots, so the slot being recorded was last written by a submission
+  // that has already completed.
+  VulkanBuffer results_{};
+  VkDescriptorSetLayout descriptorSetLayout_{VK_NULL_HANDLE};
+  VkDescriptorPool descriptorPool_{VK_NULL_HANDLE};
+  VkDescriptorSet descriptorSet_{VK_NULL_HANDLE};
+  VkPipelineLayout pipelineLayout_{VK_NULL_HANDLE};
+  std::array<VkPipeline, 2> pipelines_{};
+  uint32_t groupCount_{};
+  std::vector<float> pendingRow_;
+  size_t pendingHead_{};
+  bool rowPending_{false};
+  // The history and filter state start undefined and are cleared by the first record().
+  bool clearRequired_{true};
+  std::array<bool, kMaxFramesInFlight> slotWritten_{};
+  size_t recordCursor_{};
+  DifferentialBounds bounds_{};
+};
+
+}  // namespace uvk
@@ -1,65 +1,446 @@
 #include "waterfall_renderer.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <cstring>
 
 namespace uvk {
 
-void WaterfallRenderer::initialize(VulkanContext& context, size_t binCount, size_t historyLength) {
+void WaterfallRenderer::initialize(VulkanContext& context, size_t binCount,
+                                   const WaterfallHistoryOptions& history,
+                                   const BinAggregationOptions& aggregation,
+                                   const WaterfallEncoding& encoding) {
   if (context_) {
     shutdown();
   }
   context_ = &context;
-  binCount_ = binCount;
-  historyLength_ = historyLength;
-  waterfall_.assign(binCount_ * historyLength_, 0.0f);
+  const bool gpuRows = postOptions_.enabled && pipelineCache_ != nullptr;
+  aggregator_.configure(binCount, aggregation);
+  binCount_ = aggregator_.columnCount();
+  WaterfallEncoding storedEncoding = encoding;
+  if (gpuRows) {
+    // The compute pass writes floats and keeps the dB range for its own mapping.
+    storedEncoding.format = WaterfallFormat::Float32;
+  }
+  codec_ = WaterfallCodec(storedEncoding);
+  layout_.binCount = binCount_;
+  layout_.rowsPerTier = history.rowsPerTier;
+  layout_.tierCount = gpuRows ? 1 : std::clamp<size_t>(history.tiers, 1, kMaxWaterfallTiers);
+  layout_.encoding = codec_.encoding();
+  reduction_ = history.reduction;
+  tierHeads_.fill(0);
+  tierFill_.fill(0);
+  carryValid_.fill(false);
+  carry_.assign(binCount_ * layout_.tierCount, 0.0f);
+  decoded_.assign(binCount_, 0.0f);
+  statistics_.reset(binCount_, layout_.rowCount());
+  rowBytes_ = codec_.bytesPerSample() * binCount_;
+  row_.assign(binCount_, 0.0f);
+  // Zero decodes to silence in every format. The size is padded to whole 32-bit words, which
+  // is what the shader indexes and what vkCmdFillBuffer requires.
+  const size_t historyBytes = (rowBytes_ * layout_.rowCount() + 3) / 4 * 4;
+  if (gpuRows) {
+    storage_.clear();
+  } else {
+    storage_.assign(historyBytes, 0);
+  }
+  // A dedicated transfer queue would otherwise have to wait for the previous frame's whole
+  // draw before overwriting rows it reads; with a second copy it only waits for the frame
+  // before that.
+  layout_.copies = !gpuRows && context.dedicatedTransferQueue() ? 2 : 1;
+  copyBytes_ = historyBytes;
+  dirtyRows_.clear();
+  for (auto& rows : copyRows_) {
+    rows.clear();
+  }
+  recorded_.fill({});
+  copyResync_.fill(false);
+  resyncStaged_ = false;
+  recordCursor_ = 0;
+  stagingNext_ = 0;
 
-  if (context_) {
-    const VkDeviceSize size = sizeof(float) * waterfall_.size();
-    buffer_ = context_->createBuffer(
-        size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  if (context_ && historyBytes > 0) {
+    // The vertex shader reads the history from device-local memory; new rows travel through a
+    // small host-visible ring and are copied on the GPU timeline. It can be copied out too, so
+    // uvk_bench can check what the GPU wrote.
+    buffer_ = context_->createBuffer(historyBytes * layout_.copies,
+                                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                         VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                         VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (gpuRows) {
+      postProcessor_.initialize(*context_, *pipelineCache_, buffer_, layout_, postOptions_);
+      return;
+    }
+    staging_ = context_->createBuffer(rowBytes_ * kStagingRows,
+                                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    stagingMapped_ = static_cast<unsigned char*>(staging_.mapped);
+    // Device-local contents start undefined; the first upload into each copy zeroes it to
+    // match storage_ before copying whatever rows were written by then.
+    for (size_t copy = 0; copy < layout_.copies; ++copy) {
+      copyClear_[copy] = true;
+    }
   }
 }
 
 void WaterfallRenderer::shutdown() {
+  postProcessor_.shutdown();
   if (context_) {
+    context_->destroyBuffer(staging_);
+    context_->destroyBuffer(resyncStaging_);
     context_->destroyBuffer(buffer_);
   }
   context_ = nullptr;
-  waterfall_.clear();
+  stagingMapped_ = nullptr;
+  copyClear_.fill(false);
+  copyResync_.fill(false);
+  resyncStaged_ = false;
+  dirtyRows_.clear();
+  for (auto& rows : copyRows_) {
+    rows.clear();
+  }
+  copyBytes_ = 0;
+  storage_.clear();
+  row_.clear();
+  carry_.clear();
+  decoded_.clear();
+  statistics_.reset(0, 0);
+  rowBytes_ = 0;
   binCount_ = 0;
-  historyLength_ = 0;
+  layout_ = {};
+  tierHeads_.fill(0);
 }
 
 void WaterfallRenderer::update(const SpectrumFrame& spectrum) {
-  if (binCount_ == 0 || historyLength_ == 0) {
+  if (binCount_ == 0 || layout_.rowsPerTier == 0) {
+    return;
+  }
+  // Only the display-resolution row is kept, so storage and uploads scale with the columns
+  // and the bytes per sample of the storage format.
+  aggregator_.aggregate(spectrum.magnitudes.data(), spectrum.magnitudes.size(), row_.data());
+  if (postProcessor_.active()) {
+    // The raw row goes straight to the compute pass, which writes it at the new head.
+    tierHeads_[0] = (tierHeads_[0] + layout_.rowsPerTier - 1) % layout_.rowsPerTier;
+    postProcessor_.submitRow(row_.data(), tierHeads_[0]);
     return;
   }
+  pushRow(0, row_.data());
+}
+
+void WaterfallRenderer::pushRow(size_t tier, const float* row) {
+  // Step the head back one row so the oldest row is overwritten in place; the vertex
+  // shader resolves logical row order from the head index.
+  const size_t rows = layout_.rowsPerTier;
+  tierHeads_[tier] = (tierHeads_[tier] + rows - 1) % rows;
+  const size_t physical = tier * rows + tierHeads_[tier];
+
+  if (tierFill_[tier] < rows) {
+    ++tierFill_[tier];
+  } else if (tier + 1 < layout_.tierCount) {
+    // The row about to be overwritten ages out of this tier. Rows leave in time order, so
+    // consecutive pairs are reduced into one row of the next, twice as coarse, tier.
+    decodeRow(physical, decoded_.data());
+    float* carry = carry_.data() + (tier + 1) * binCount_;
+    if (!carryValid_[tier + 1]) {
+      std::copy(decoded_.begin(), decoded_.end(), carry);
+      carryValid_[tier + 1] = true;
+    } else {
+      if (reduction_ == HistoryReduction::Max) {
+        for (size_t col = 0; col < binCount_; ++col) {
+          carry[col] = std::max(carry[col], decoded_[col]);
+        }
+      } else {
+        for (size_t col = 0; col < binCount_; ++col) {
+          carry[col] = 0.5f * (carry[col] + decoded_[col]);
+        }
+      }
+      carryValid_[tier + 1] = false;
+      pushRow(tier + 1, carry);
+    }
+  }
+
+  codec_.encode(row, binCount_, storage_.data() + physical * rowBytes_);
+  // The statistics see the quantized row, as the renderer does.
+  decodeRow(physical, decoded_.data());
+  statistics_.replaceRow(physical, decoded_.data());
+  markDirty(physical);
+}
+
+DifferentialBounds WaterfallRenderer::differentialBounds() const {
+  if (postProcessor_.active()) {
+    return postProcessor_.bounds();
+  }
+  if (layout_.rowCount() == 0) {
+    return {};
+  }
+  return statistics_.bounds(physicalRow(0), physicalRow(layout_.rowCount() - 1), true);
+}
 
-  const size_t rowSize = binCount_;
-  const size_t dataSize = rowSize * historyLength_;
-  if (waterfall_.size() != dataSize) {
-    waterfall_.assign(dataSize, 0.0f);
+WaterfallStatistics WaterfallRenderer::scanHistory(size_t bandCount,
+                                                   EnkiTaskScheduler* scheduler) const {
+  if (postProcessor_.active()) {
+    return {};
+  }
+  // decodeRow() only reads storage_ and the codec, so tasks may decode rows concurrently.
+  return DifferentialMath::scanRows(
+      [this](size_t row, float* output) { decodeRow(physicalRow(row), output); }, binCount_,
+      layout_.rowCount(), 0, bandCount, scheduler);
+}
+
+void WaterfallRenderer::markDirty(size_t physical) {
+  if (buffer_.buffer == VK_NULL_HANDLE || everyCopyResyncing()) {
+    return;
   }
+  if (dirtyRows_.size() >= layout_.rowCount()) {
+    // Every row has changed since the last upload; resend the whole history instead.
+    requestResync();
+  } else {
+    dirtyRows_.push_back(physical);
+  }
+}
 
-  for (size_t row = historyLength_ - 1; row > 0; --row) {
-    std::copy_n(&waterfall_[(row - 1) * rowSize], rowSize, &waterfall_[row * rowSize]);
+void WaterfallRenderer::requestResync() {
+  for (size_t copy = 0; copy < layout_.copies; ++copy) {
+    copyResync_[copy] = true;
+    copyRows_[copy].clear();
   }
+  dirtyRows_.clear();
+}
+
+bool WaterfallRenderer::everyCopyResyncing() const noexcept {
+  return std::all_of(copyResync_.begin(), copyResync_.begin() + layout_.copies,
+                     [](bool resync) { return resync; });
+}
+
+size_t WaterfallRenderer::historySpan() const noexcept {
+  // Tier k holds rowsPerTier rows of 2^k input rows each.
+  return layout_.rowsPerTier * ((size_t{1} << layout_.tierCount) - 1);
+}
 
-  const size_t copyCount = std::min(rowSize, spectrum.magnitudes.size());
-  std::fill_n(waterfall_.begin(), rowSize, 0.0f);
-  std::copy_n(spectrum.magnitudes.begin(), copyCount, waterfall_.begin());
+size_t WaterfallRenderer::physicalRow(size_t logicalRow) const noexcept {
+  const size_t rows = layout_.rowsPerTier;
+  const size_t tier = logicalRow / rows;
+  return tier * rows + (tierHeads_[tier] + logicalRow % rows) % rows;
 }
 
 void WaterfallRenderer::uploadToGpu() {
-  if (!context_ || buffer_.buffer == VK_NULL_HANDLE) {
+  if (!stagingMapped_) {
     return;
   }
-  void* mapped = nullptr;
-  vkMapMemory(context_->device(), buffer_.memory, 0, buffer_.size, 0, &mapped);
-  std::memcpy(mapped, waterfall_.data(), buffer_.size);
-  vkUnmapMemory(context_->device(), buffer_.memory);
+  bool staged = false;
+  for (const size_t row : dirtyRows_) {
+    // A slot may only be reused once nothing still to be recorded or in flight can copy
+    // from it.
+    if (stagingRowsOutstanding() + stagingRowsInFlight() >= kStagingRows) {
+      requestResync();
+      break;
+    }
+    copyRowToStaging(row);
+    staged = true;
+  }
+  dirtyRows_.clear();
+  if (staged) {
+    context_->flushBuffer(staging_);
+  }
+  if (copyResync_[historyCopy()]) {
+    stageResync(historyCopy());
+  }
+}
+
+void WaterfallRenderer::stageResync(size_t copy) {
+  // The whole history goes through its own staging buffer, allocated on the first resync with
+  // one region per copy. A region is reused only once no submission that may still copy from
+  // it is in flight; until then the resync waits and that copy keeps the previous rows.
+  for (const auto& upload : recorded_) {
+    if (upload.resync && upload.copy == copy) {
+      return;
+    }
+  }
+  if (resyncStaging_.buffer == VK_NULL_HANDLE) {
+    resyncStaging_ = context_->createBuffer(copyBytes_ * layout_.copies,
+                                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+  }
+  std::memcpy(static_cast<unsigned char*>(resyncStaging_.mapped) + copyBytes_ * copy,
+              storage_.data(), storage_.size());
+  context_->flushBuffer(resyncStaging_);
+  resyncStaged_ = true;
+}
+
+bool WaterfallRenderer::recordUpload(const UploadCommands& commands) {
+  if (postProcessor_.active()) {
+    // The compute pass and its one-row upload stay on the graphics queue.
+    postProcessor_.record(commands.graphics);
+    return false;
+  }
+  if (buffer_.buffer == VK_NULL_HANDLE) {
+    return false;
+  }
+  const size_t copy = historyCopy();
+  const VkDeviceSize copyOffset = copyBytes_ * copy;
+  const bool resync = resyncStaged_;
+  // The same row may have been staged again since this copy was last written; only its
+  // newest slot is copied, since overlapping regions in one copy command are undefined.
+  std::vector<VkBufferCopy> regions;
+  const auto& rows = copyRows_[copy];
+  if (!resync) {
+    regions.reserve(rows.size());
+    for (size_t i = rows.size(); i-- > 0;) {
+      const size_t row = rows[i].row;
+      const bool newer = std::any_of(rows.begin() + static_cast<std::ptrdiff_t>(i) + 1,
+                                     rows.end(), [row](const auto& r) { return r.row == row; });
+      if (!newer) {
+        VkBufferCopy region{};
+        region.srcOffset = rowBytes_ * rows[i].slot;
+        region.dstOffset = copyOffset + rowBytes_ * row;
+        region.size = rowBytes_;
+        regions.push_back(region);
+      }
+    }
+  }
+  const bool clear = copyClear_[copy] && !resync;
+  const size_t stagedRows = resync ? 0 : rows.size();
+  const bool recorded = resync || clear || !regions.empty();
+  if (recorded) {
+    VkCommandBuffer commandBuffer = commands.transfer;
+    const bool ownershipTransfer = commands.ownershipTransfer();
+    if (!ownershipTransfer) {
+      // Earlier frames may still be drawing from the rows about to be overwritten. Across
+      // queues the transfer submission waits for those frames instead.
+      VkBufferMemoryBarrier beforeWrite{};
+      beforeWrite.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+      beforeWrite.srcAccessMask = 0;
+      beforeWrite.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      beforeWrite.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      beforeWrite.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      beforeWrite.buffer = buffer_.buffer;
+      beforeWrite.offset = copyOffset;
+      beforeWrite.size = copyBytes_;
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                           VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &beforeWrite, 0,
+                           nullptr);
+    }
+
+    // Every written range is replaced whole, so the transfer family never has to acquire it
+    // first; it only releases it to the graphics family afterwards.
+    std::vector<VkBufferMemoryBarrier> written;
+    VkBufferMemoryBarrier range{};
+    range.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    range.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    range.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    range.srcQueueFamilyIndex = ownershipTransfer ? commands.transferFamily
+                                                  : VK_QUEUE_FAMILY_IGNORED;
+    range.dstQueueFamilyIndex = ownershipTransfer ? commands.graphicsFamily
+                                                  : VK_QUEUE_FAMILY_IGNORED;
+    range.buffer = buffer_.buffer;
+    if (resync || clear) {
+      range.offset = copyOffset;
+      range.size = copyBytes_;
+      written.push_back(range);
+    }
+    if (resync) {
+      VkBufferCopy region{};
+      region.srcOffset = copyOffset;
+      region.dstOffset = copyOffset;
+      region.size = copyBytes_;
+      vkCmdCopyBuffer(commandBuffer, resyncStaging_.buffer, buffer_.buffer, 1, &region);
+      copyResync_[copy] = false;
+      copyClear_[copy] = false;
+      resyncStaged_ = false;
+    }
+    if (clear) {
+      vkCmdFillBuffer(commandBuffer, buffer_.buffer, copyOffset, copyBytes_, 0);
+      copyClear_[copy] = false;
+      if (!regions.empty()) {
+        // The row copies land on top of the fill.
+        VkBufferMemoryBarrier afterFill = range;
+        afterFill.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        afterFill.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        afterFill.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &afterFill, 0,
+                             nullptr);
+      }
+    }
+    if (!regions.empty()) {
+      if (written.empty()) {
+        for (const auto& region : regions) {
+          range.offset = region.dstOffset;
+          range.size = region.size;
+          written.push_back(range);
+        }
+      }
+      vkCmdCopyBuffer(commandBuffer, staging_.buffer, buffer_.buffer,
+                      static_cast<uint32_t>(regions.size()), regions.data());
+    }
+
+    const auto barrierCount = static_cast<uint32_t>(written.size());
+    if (ownershipTransfer) {
+      // Release on the transfer queue, then acquire on the graphics queue; the graphics
+      // submission waits on the semaphore the transfer submission signals.
+      for (auto& barrier : written) {
+        barrier.dstAccessMask = 0;
+      }
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                           VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, barrierCount,
+                           written.data(), 0, nullptr);
+      for (auto& barrier : written) {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+      }
+      vkCmdPipelineBarrier(commands.graphics, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                           VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, nullptr, barrierCount,
+                           written.data(), 0, nullptr);
+    } else {
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                           VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, nullptr, barrierCount,
+                           written.data(), 0, nullptr);
+    }
+  }
+  copyRows_[copy].clear();
+  recorded_[recordCursor_ % recorded_.size()] = {stagedRows, resync, copy};
+  ++recordCursor_;
+  return recorded;
+}
+
+void WaterfallRenderer::copyRowToStaging(size_t row) {
+  const size_t slot = stagingNext_ % kStagingRows;
+  ++stagingNext_;
+  std::memcpy(stagingMapped_ + slot * rowBytes_, storage_.data() + row * rowBytes_, rowBytes_);
+  for (size_t copy = 0; copy < layout_.copies; ++copy) {
+    // A copy waiting for a resync gets every row from it instead.
+    if (!copyResync_[copy]) {
+      copyRows_[copy].push_back({slot, row});
+    }
+  }
+}
+
+void WaterfallRenderer::decodeRow(size_t row, float* output) const {
+  if (storage_.empty()) {
+    std::fill(output, output + binCount_, 0.0f);
+    return;
+  }
+  codec_.decode(storage_.data() + row * rowBytes_, binCount_, output);
+}
+
+size_t WaterfallRenderer::stagingRowsOutstanding() const noexcept {
+  // A slot staged for both copies counts twice, which only makes the check stricter.
+  size_t rows = 0;
+  for (const auto& copyRows : copyRows_) {
+    rows += copyRows.size();
+  }
+  return rows;
+}
+
+size_t WaterfallRenderer::stagingRowsInFlight() const noexcept {
+  // A slot copied into both copies is counted by both submissions, so it stays reserved until
+  // the later one is out of the window.
+  size_t rows = 0;
+  for (const auto& upload : recorded_) {
+    rows += upload.stagingRows;
+  }
+  return rows;
 }
 
 }  // namespace uvk
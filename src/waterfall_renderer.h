@@ -1,30 +1,160 @@
 #pragma once
 
+#include "bin_aggregator.h"
+#include "differential_math.h"
 #include "spectrum_analyzer.h"
 #include "vulkan_context.h"
+#include "waterfall_format.h"
+#include "waterfall_post_processor.h"
 
+#include <array>
 #include <vector>
 
 namespace uvk {
 
+enum class HistoryReduction {
+  Max,
+  Mean,
+};
+
+struct WaterfallHistoryOptions {
+  size_t rowsPerTier{120};
+  // Tier 0 holds the newest rows at full time resolution; each row of tier k summarizes 2^k
+  // input rows, so the span covered doubles per tier while memory grows by one tier. Clamped
+  // to [1, kMaxWaterfallTiers].
+  size_t tiers{1};
+  HistoryReduction reduction{HistoryReduction::Max};
+};
+
 class WaterfallRenderer {
  public:
-  void initialize(VulkanContext& context, size_t binCount, size_t historyLength);
+  // Must be called before initialize(). With post-processing enabled the history is a single
+  // f32 tier that only the GPU writes, and no CPU copy of it is kept.
+  void setPostProcess(const WaterfallPostProcessOptions& options, PipelineCache* pipelineCache) {
+    postOptions_ = options;
+    pipelineCache_ = pipelineCache;
+  }
+  // `binCount` is the analysis resolution; rows are stored and uploaded at
+  // aggregation.columns instead when that is smaller.
+  void initialize(VulkanContext& context, size_t binCount, const WaterfallHistoryOptions& history,
+                  const BinAggregationOptions& aggregation = {},
+                  const WaterfallEncoding& encoding = {});
   void shutdown();
   void update(const SpectrumFrame& spectrum);
+  // Copies rows written since the last call into the persistently mapped staging ring.
   void uploadToGpu();
+  // Records the staged row copies into historyCopy() of the device-local buffer, moving the
+  // written rows to the graphics family when the copies run on a dedicated transfer queue.
+  // Must be called once per frame, outside a render pass and before the draw that reads the
+  // waterfall. Returns false when nothing was recorded into commands.transfer, so a dedicated
+  // transfer queue has nothing to submit.
+  bool recordUpload(const UploadCommands& commands);
 
+  // Columns per stored row, i.e. what the GPU sees.
   [[nodiscard]] size_t binCount() const noexcept { return binCount_; }
-  [[nodiscard]] size_t historyLength() const noexcept { return historyLength_; }
-  [[nodiscard]] const std::vector<float>& waterfall() const noexcept { return waterfall_; }
+  [[nodiscard]] size_t inputBinCount() const noexcept { return aggregator_.inputBins(); }
+  // Logical rows across every tier.
+  [[nodiscard]] size_t historyLength() const noexcept { return layout_.rowCount(); }
+  [[nodiscard]] const WaterfallLayout& layout() const noexcept { return layout_; }
+  // Head row of each tier's ring, relative to the tier's first physical row.
+  [[nodiscard]] const std::array<size_t, kMaxWaterfallTiers>& tierHeads() const noexcept {
+    return tierHeads_;
+  }
+  // Copy of the history the next recordUpload() writes and the frame it belongs to draws.
+  // Alternates per frame when layout().copies is 2, i.e. with a dedicated transfer queue.
+  [[nodiscard]] size_t historyCopy() const noexcept { return recordCursor_ % layout_.copies; }
+  // Input rows covered by the full history.
+  [[nodiscard]] size_t historySpan() const noexcept;
+  [[nodiscard]] size_t physicalRow(size_t logicalRow) const noexcept;
+  // Equals DifferentialMath::analyzeRows() over the logical history, maintained as rows are
+  // written rather than rescanned.
+  [[nodiscard]] DifferentialBounds differentialBounds() const;
+  // One full pass over the decoded logical history, newest row first, split over the
+  // scheduler's threads; for one-off summaries rather than per frame. Empty when the GPU owns
+  // the history.
+  [[nodiscard]] WaterfallStatistics scanHistory(size_t bandCount,
+                                                EnkiTaskScheduler* scheduler) const;
+  [[nodiscard]] bool gpuPostProcess() const noexcept { return postProcessor_.active(); }
+  // Expands physical row `row` to linear magnitudes; `output` holds binCount() floats. Reads
+  // as silence when the GPU owns the history.
+  void decodeRow(size_t row, float* output) const;
+  [[nodiscard]] const WaterfallEncoding& encoding() const noexcept { return codec_.encoding(); }
+  // Encoded history as stored on the CPU and mirrored on the GPU.
+  [[nodiscard]] const std::vector<unsigned char>& storage() const noexcept { return storage_; }
   [[nodiscard]] const VulkanBuffer& buffer() const noexcept { return buffer_; }
 
  private:
+  // Rows the staging ring can hold; more pending rows than fit fall back to a full resync.
+  // An update writes one row to tier 0 and, as rows age out, occasionally one to later tiers.
+  static constexpr size_t kStagingRows = 32;
+
+  struct PendingCopy {
+    size_t slot{};
+    size_t row{};
+  };
+
+  struct RecordedUpload {
+    // Staging ring slots the submission copies from.
+    size_t stagingRows{};
+    // Whether it copied its history copy from resyncStaging_.
+    bool resync{false};
+    size_t copy{};
+  };
+
+  // Writes `row` as the newest row of `tier`, cascading the row it evicts into the next tier.
+  void pushRow(size_t tier, const float* row);
+  void markDirty(size_t physical);
+  // Stages `row` for every copy that is not waiting for a resync.
+  void copyRowToStaging(size_t row);
+  // Copies the whole history into resyncStaging_'s region for `copy`, unless a submission may
+  // still be reading that region.
+  void stageResync(size_t copy);
+  void requestResync();
+  [[nodiscard]] bool everyCopyResyncing() const noexcept;
+  // Slots staged for a copy but not recorded yet.
+  [[nodiscard]] size_t stagingRowsOutstanding() const noexcept;
+  [[nodiscard]] size_t stagingRowsInFlight() const noexcept;
+
   VulkanContext* context_{nullptr};
+  BinAggregator aggregator_;
+  WaterfallCodec codec_;
   VulkanBuffer buffer_{};
+  VulkanBuffer staging_{};
+  unsigned char* stagingMapped_{nullptr};
+  size_t stagingNext_{};
+  std::vector<size_t> dirtyRows_;
+  // Rows each copy still lacks, staged but not recorded yet.
+  std::array<std::vector<PendingCopy>, kMaxWaterfallCopies> copyRows_;
+  // The most recent submissions, which the GPU may still be reading from.
+  std::array<RecordedUpload, kMaxFramesInFlight> recorded_{};
+  size_t recordCursor_{};
+  // Bytes of one history copy in buffer_ and in resyncStaging_.
+  size_t copyBytes_{};
+  // A copy that has never been written is zero-filled rather than uploaded.
+  std::array<bool, kMaxWaterfallCopies> copyClear_{};
+  // A copy that missed rows is rewritten whole from resyncStaging_.
+  std::array<bool, kMaxWaterfallCopies> copyResync_{};
+  // resyncStaging_ holds the current history for the next recorded upload.
+  bool resyncStaged_{false};
+  VulkanBuffer resyncStaging_{};
   size_t binCount_{};
-  size_t historyLength_{};
-  std::vector<float> waterfall_;
+  WaterfallLayout layout_{};
+  HistoryReduction reduction_{HistoryReduction::Max};
+  std::array<size_t, kMaxWaterfallTiers> tierHeads_{};
+  std::array<size_t, kMaxWaterfallTiers> tierFill_{};
+  // First row of a pair waiting to be reduced into tier k (binCount floats per tier).
+  std::vector<float> carry_;
+  std::array<bool, kMaxWaterfallTiers> carryValid_{};
+  // Scratch row for decoding evicted rows and the rows just written.
+  std::vector<float> decoded_;
+  SlidingDifferential statistics_;
+  size_t rowBytes_{};
+  // Rows are quantized once, on the way in; row_ is the aggregated row before encoding.
+  std::vector<float> row_;
+  std::vector<unsigned char> storage_;
+  WaterfallPostProcessOptions postOptions_{};
+  PipelineCache* pipelineCache_{nullptr};
+  WaterfallPostProcessor postProcessor_;
 };
 
 }  // namespace uvk
@@ -0,0 +1,174 @@
+// CPU-only checks for the waterfall statistics; needs no Vulkan device, so it runs under ctest
+// on any machine that can build the project.
+
+#include "differential_math.h"
+#include "waterfall_format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace uvk {
+
+namespace {
+
+// Both sides sum the same samples in different orders, so only the gradients may differ, and
+// only by rounding.
+bool close(float a, float b) {
+  return std::abs(a - b) <= 1e-5f + 1e-3f * std::abs(b);
+}
+
+bool sameBounds(const DifferentialBounds& maintained, const DifferentialBounds& rescanned) {
+  for (size_t axis = 0; axis < 3; ++axis) {
+    if (maintained.bounds.min[axis] != rescanned.bounds.min[axis] ||
+        maintained.bounds.max[axis] != rescanned.bounds.max[axis] ||
+        !close(maintained.gradient[axis], rescanned.gradient[axis])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Replaces rows of a SlidingDifferential the way a tiered history does, mostly stepping a ring
+// head and sometimes rewriting an arbitrary row or reordering the logical rows, and compares
+// its bounds with an analyzeRows() rescan after every change. Rows are quantized through the
+// storage format first, as the renderer does.
+bool checkSlidingDifferential(WaterfallFormat format, size_t binCount, size_t rowCount,
+                              unsigned seed) {
+  WaterfallEncoding encoding;
+  encoding.format = format;
+  const WaterfallCodec codec(encoding);
+  std::vector<unsigned char> encoded(binCount * codec.bytesPerSample());
+  std::vector<float> history(binCount * rowCount, 0.0f);
+  // Logical row (newest first) to physical row.
+  std::vector<size_t> order(rowCount);
+  std::iota(order.begin(), order.end(), size_t{0});
+
+  SlidingDifferential sliding;
+  sliding.reset(binCount, rowCount);
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> magnitude(0.0f, 1.0f);
+  std::vector<float> row(binCount);
+
+  const auto matches = [&]() {
+    const DifferentialBounds maintained =
+        sliding.bounds(order.front(), order.back(), true);
+    const DifferentialBounds rescanned = DifferentialMath::analyzeRows(
+        [&](size_t logical, float* output) {
+          const float* source = history.data() + order[logical] * binCount;
+          std::copy(source, source + binCount, output);
+        },
+        binCount, rowCount, true);
+    return sameBounds(maintained, rescanned);
+  };
+
+  if (!matches()) {
+    std::cerr << "Check failed: SlidingDifferential differs from analyzeRows() after reset for "
+              << waterfallFormatName(format) << ", " << binCount << "x" << rowCount << '\n';
+    return false;
+  }
+  constexpr size_t kUpdates = 500;
+  for (size_t update = 0; update < kUpdates; ++update) {
+    for (float& sample : row) {
+      sample = magnitude(random);
+    }
+    codec.encode(row.data(), binCount, encoded.data());
+    const float choice = magnitude(random);
+    size_t physical = order.back();
+    if (choice < 0.1f) {
+      physical = order[static_cast<size_t>(magnitude(random) * static_cast<float>(rowCount)) %
+                       rowCount];
+    } else if (choice < 0.15f) {
+      std::shuffle(order.begin(), order.end(), random);
+    } else {
+      // The oldest row becomes the newest, as when a ring head steps back.
+      std::rotate(order.rbegin(), order.rbegin() + 1, order.rend());
+    }
+    float* target = history.data() + physical * binCount;
+    codec.decode(encoded.data(), binCount, target);
+    sliding.replaceRow(physical, target);
+    if (!matches()) {
+      std::cerr << "Check failed: SlidingDifferential differs from analyzeRows() after "
+                << update + 1 << " updates for " << waterfallFormatName(format) << ", "
+                << binCount << "x" << rowCount << '\n';
+      return false;
+    }
+  }
+  return true;
+}
+
+// scanRows() must agree with scanWaterfall() over the same floats, serially and split over
+// the scheduler.
+bool checkScanRows(EnkiTaskScheduler& scheduler) {
+  constexpr size_t kBins = 1280;
+  constexpr size_t kRows = 120;
+  constexpr size_t kBands = 8;
+  std::vector<float> history(kBins * kRows);
+  std::mt19937 random(5);
+  std::uniform_real_distribution<float> magnitude(-1.0f, 1.0f);
+  for (float& sample : history) {
+    sample = magnitude(random);
+  }
+  const DifferentialMath::RowReader readRow = [&history](size_t row, float* output) {
+    std::copy_n(history.begin() + static_cast<std::ptrdiff_t>(row * kBins), kBins, output);
+  };
+  for (size_t headRow : {size_t{0}, size_t{7}, kRows - 1}) {
+    for (EnkiTaskScheduler* tasks : {static_cast<EnkiTaskScheduler*>(nullptr), &scheduler}) {
+      const WaterfallStatistics floats =
+          DifferentialMath::scanWaterfall(history, kBins, kRows, headRow, kBands, tasks);
+      const WaterfallStatistics rows =
+          DifferentialMath::scanRows(readRow, kBins, kRows, headRow, kBands, tasks);
+      if (!sameBounds(rows.differential, floats.differential) ||
+          rows.rowMaxima != floats.rowMaxima || rows.bandMeans != floats.bandMeans ||
+          rows.bandGradients != floats.bandGradients) {
+        std::cerr << "Check failed: scanRows() differs from scanWaterfall() with head row "
+                  << headRow << (tasks ? " on the scheduler" : "") << '\n';
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// A buffer shorter than the history only counts the samples it holds.
+bool checkPartialWaterfall() {
+  constexpr size_t kBins = 16;
+  constexpr size_t kRows = 8;
+  std::vector<float> samples(kBins * 3 + 5);
+  std::iota(samples.begin(), samples.end(), 1.0f);
+  const DifferentialBounds bounds =
+      DifferentialMath::analyzeWaterfall(samples, kBins, kRows, false);
+  if (bounds.bounds.min[1] != 1.0f || bounds.bounds.max[1] != samples.back()) {
+    std::cerr << "Check failed: analyzeWaterfall() of a short buffer reports bounds ["
+              << bounds.bounds.min[1] << ", " << bounds.bounds.max[1] << "]\n";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+}  // namespace uvk
+
+int main() {
+  using namespace uvk;
+  bool passed = true;
+  for (WaterfallFormat format :
+       {WaterfallFormat::Float32, WaterfallFormat::Float16, WaterfallFormat::Db8}) {
+    passed = checkSlidingDifferential(format, 256, 96, 11) && passed;
+    passed = checkSlidingDifferential(format, 3, 5, 17) && passed;
+  }
+  passed = checkSlidingDifferential(WaterfallFormat::Float32, 64, 2, 23) && passed;
+  EnkiTaskScheduler scheduler;
+  scheduler.initialize(4);
+  passed = checkScanRows(scheduler) && passed;
+  passed = checkPartialWaterfall() && passed;
+  std::cout << (passed ? "All differential math checks passed.\n"
+                       : "Differential math checks failed.\n");
+  return passed ? 0 : 1;
+}